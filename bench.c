@@ -0,0 +1,356 @@
+// Benchmark of the listing, sort and render paths on generated directories.
+//
+//   make bench                        all fixture sizes, results go to bench_output.txt
+//   make bench BENCH_SIZES="10000"    only the given sizes
+//
+// Every fixture is timed for: reading the directory (as update_panel_files() does it when
+// entering it, including the sort), sorting alone, refreshing it after one entry was removed and
+// added again, redrawing both panels, and moving the cursor through the real main loop with Down
+// keys. mc draws to an off-screen terminal on a pty. The refreshes must patch the sorted view
+// instead of sorting again, else the exit status is 1.
+// Results are printed one per line, tab separated: fixture, entries, metric, value, unit.
+
+// the benchmark links all of mc but its main(), mc.c also holds the globals
+#define main mc_main
+#include "mc.c"
+#undef main
+
+#define BENCH_SCAN_RUNS      3
+#define BENCH_RENDER_FRAMES  200
+#define BENCH_CURSOR_KEYS    2000
+#define BENCH_DEEP_LEVELS    32
+#define BENCH_DEEP_ENTRIES   10000
+#define BENCH_TERM_ROWS      50
+#define BENCH_TERM_COLS      200
+
+static int pty_master = -1;
+static volatile long pty_bytes = 0;         // bytes mc wrote to the terminal so far
+static struct timespec pty_last_output = {0};
+static int bench_failed = 0;               // a check on the way failed, the exit status tells
+
+// Down keys typed into the main loop once it is ready
+typedef struct KeyFeed {
+    int keys;
+    long bytes;   // pty_bytes before mc started, then once it drew its first screen
+    struct timespec start;
+} KeyFeed;
+
+
+static double elapsed_ms(struct timespec *start) {
+    return elapsed_us(start) / 1000.0;
+}
+
+
+// Everything mc writes to the terminal has to be read, otherwise it would block once the pty is full
+static void *pty_drain(void *arg) {
+    char buffer[65536];
+    ssize_t len;
+
+    while ((len = read(pty_master, buffer, sizeof(buffer))) > 0) {
+        __atomic_add_fetch(&pty_bytes, len, __ATOMIC_SEQ_CST);
+        clock_gettime(CLOCK_MONOTONIC, &pty_last_output);
+    }
+    return NULL;
+}
+
+
+// Wait until mc wrote something and then stayed quiet for 'quiet_ms', returns the bytes written so far
+static long pty_wait_quiet(long since_bytes, int quiet_ms) {
+    while (1) {
+        usleep(10000);
+        long bytes = __atomic_load_n(&pty_bytes, __ATOMIC_SEQ_CST);
+        if (bytes > since_bytes && elapsed_us(&pty_last_output) >= quiet_ms * 1000L) return bytes;
+    }
+}
+
+
+// Put mc on an off-screen terminal, it becomes the process' stdin as mc polls that for keys
+static int pty_open() {
+    pty_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (pty_master == -1 || grantpt(pty_master) != 0 || unlockpt(pty_master) != 0) return -1;
+
+    int pty_slave = open(ptsname(pty_master), O_RDWR | O_NOCTTY);
+    if (pty_slave == -1) return -1;
+
+    struct winsize size = { .ws_row = BENCH_TERM_ROWS, .ws_col = BENCH_TERM_COLS };
+    ioctl(pty_slave, TIOCSWINSZ, &size);
+    dup2(pty_slave, STDIN_FILENO);
+
+    pthread_t drain;
+    if (pthread_create(&drain, NULL, pty_drain, NULL) != 0) return -1;
+    pthread_detach(drain);
+
+    screen = newterm("xterm", fdopen(pty_slave, "w"), stdin);
+    return screen == NULL ? -1 : 0;
+}
+
+
+// Type Down keys into mc once it drew its first screen, then quit it with F10
+static void *feed_keys(void *arg) {
+    KeyFeed *feed = arg;
+
+    feed->bytes = pty_wait_quiet(feed->bytes, 100);
+
+    clock_gettime(CLOCK_MONOTONIC, &feed->start);
+    for (int i = 0; i < feed->keys; i++) {
+        write(pty_master, "\033[B", 3);
+    }
+    write(pty_master, "\033[21~", 5);
+    return NULL;
+}
+
+
+static void report(const char *fixture, int entries, const char *metric, double value, const char *unit) {
+    printf("%s\t%d\t%s\t%.3f\t%s\n", fixture, entries, metric, value, unit);
+    fflush(stdout);
+}
+
+
+static void create_file(const char *path, off_t size) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) return;
+    if (size > 0) ftruncate(fd, size);  // sparse, only the size matters
+    close(fd);
+}
+
+
+// Fill 'dir' with 'count' entries: mostly files with various sizes and extensions,
+// some directories, some long names and symlinks to files, to directories and to nothing
+static void create_entries(const char *dir, int count) {
+    const char *extensions[] = {".c", ".h", ".txt", ".tar.gz", ".sh", ".png", "", ".md"};
+    char path[CMD_MAX];
+    char target[CMD_MAX];
+    unsigned int seed = 12345;
+
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1103515245 + 12345;
+        unsigned int r = seed >> 8;
+        const char *ext = extensions[r % 8];
+
+        switch (i % 20) {
+            case 0:
+                snprintf(path, sizeof(path), "%s/dir_%07u_%d", dir, r % 10000000, i);
+                mkdir(path, 0755);
+                break;
+            case 1:
+                snprintf(path, sizeof(path), "%s/link_%07u_%d", dir, r % 10000000, i);
+                snprintf(target, sizeof(target), "file_%d%s", i - 1, ext);
+                symlink(target, path);
+                break;
+            case 2:
+                snprintf(path, sizeof(path), "%s/dirlink_%d", dir, i);
+                symlink(".", path);
+                break;
+            case 3:
+                snprintf(path, sizeof(path), "%s/broken_%d", dir, i);
+                symlink("does/not/exist", path);
+                break;
+            case 4:
+            case 5:
+                snprintf(path, sizeof(path), "%s/%0200d_long_name_%u%s", dir, i, r, ext);
+                create_file(path, r % 100000);
+                break;
+            default:
+                snprintf(path, sizeof(path), "%s/File_%u_%d%s", dir, r % 1000000, i, ext);
+                create_file(path, (off_t)(r % 1000) * (r % 1000) * (r % 1000));
+                break;
+        }
+    }
+}
+
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    remove(path);
+    return 0;
+}
+
+
+// Time the listing paths of the directory 'path' and report them as 'fixture'
+static void bench_directory(const char *fixture, const char *path) {
+    struct timespec start;
+    double runs[BENCH_SCAN_RUNS];
+    int entries = 0;
+
+    fprintf(stderr, "bench: %s\n", fixture);
+    chdir(path);
+    snprintf(left_panel.path, sizeof(left_panel.path), "%s", path);
+    snprintf(right_panel.path, sizeof(right_panel.path), "%s", path);
+    left_panel.sort_order = SORT_BY_NAME_DIRSFIRST_ASC;
+    right_panel.sort_order = SORT_BY_NAME_DIRSFIRST_ASC;
+    panel_set_files(&right_panel, NULL, NULL, 0);
+    active_panel = &left_panel;
+
+    // reading a directory, like entering it
+    for (int run = 0; run < BENCH_SCAN_RUNS; run++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        entries = update_panel_files(&left_panel);
+        runs[run] = elapsed_ms(&start);
+    }
+    double best = runs[0];
+    for (int run = 1; run < BENCH_SCAN_RUNS; run++) {
+        if (runs[run] < best) best = runs[run];
+    }
+    report(fixture, entries, "scan", best, "ms");
+
+    // sorting alone, from directory order
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    sort_panel_files(&left_panel);
+    report(fixture, entries, "sort_name", elapsed_ms(&start), "ms");
+
+    resolve_panel_files(&left_panel, 0, left_panel.files_count, SCAN_NEED_SIZE);
+    left_panel.sort_order = SORT_BY_SIZE_DESC;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    sort_panel_files(&left_panel);
+    report(fixture, entries, "sort_size", elapsed_ms(&start), "ms");
+
+    left_panel.sort_order = SORT_BY_NAME_DIRSFIRST_ASC;
+    sort_panel_files(&left_panel);
+
+    // refreshing after one early entry went away and came back, both only patch the view
+    char removed[CMD_MAX] = {0};
+    for (int row = left_panel.files_count / 20; row < left_panel.files_count && removed[0] == '\0'; row++) {
+        FileNode *node = &left_panel.files->nodes[left_panel.order[row]];
+        if (!node->is_dir && !node->is_link) snprintf(removed, sizeof(removed), "%s/%s", path, node->name);
+    }
+    if (removed[0] != '\0') {
+        int sorts = incremental_sorts;
+        unlink(removed);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        update_panel_files(&left_panel);
+        report(fixture, entries, "refresh_removed", elapsed_ms(&start), "ms");
+
+        create_file(removed, 0);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        update_panel_files(&left_panel);
+        report(fixture, entries, "refresh_added", elapsed_ms(&start), "ms");
+
+        if (incremental_sorts - sorts != 2) {
+            fprintf(stderr, "bench: %s: a refresh after one change sorted from scratch\n", fixture);
+            bench_failed = 1;
+        }
+    }
+    update_panel_files(&right_panel);
+
+    // drawing both panels, scrolled by a page every frame, and redrawing an unchanged frame
+    init_screen();
+    redraw_ui();
+    int visible_items = getmaxy(win1) - 5;
+    long bytes = pty_wait_quiet(-1, 50);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int frame = 0; frame < BENCH_RENDER_FRAMES; frame++) {
+        int pages = entries > visible_items ? entries - visible_items : 1;
+        left_panel.scroll_index = (frame * visible_items) % pages;
+        left_panel.selected_index = left_panel.scroll_index;
+        update_panel(win1, &left_panel);
+        update_panel(win2, &right_panel);
+        doupdate();
+    }
+    double frame_ms = elapsed_ms(&start) / BENCH_RENDER_FRAMES;
+    long frame_bytes = pty_wait_quiet(bytes, 50) - bytes;
+    report(fixture, entries, "frame", frame_ms, "ms");
+    report(fixture, entries, "frame_bytes", (double)frame_bytes / BENCH_RENDER_FRAMES, "bytes");
+
+    bytes = __atomic_load_n(&pty_bytes, __ATOMIC_SEQ_CST);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int frame = 0; frame < BENCH_RENDER_FRAMES; frame++) {
+        update_panel(win1, &left_panel);
+        update_panel(win2, &right_panel);
+        doupdate();
+    }
+    frame_ms = elapsed_ms(&start) / BENCH_RENDER_FRAMES;
+    usleep(100000);
+    frame_bytes = __atomic_load_n(&pty_bytes, __ATOMIC_SEQ_CST) - bytes;
+    report(fixture, entries, "idle_frame", frame_ms, "ms");
+    report(fixture, entries, "idle_frame_bytes", (double)frame_bytes / BENCH_RENDER_FRAMES, "bytes");
+
+    // cursor movement through the main loop: mc reads the directory, draws, then gets Down keys and F10.
+    // Without windows mc draws nothing while it loads, and on a cleared screen its first frame is
+    // never empty, so its first output means it is past loading.
+    clear();
+    refresh();
+    endwin();
+    delwin(win1);
+    delwin(win2);
+    win1 = win2 = NULL;
+    usleep(100000);
+    panel_set_files(&left_panel, NULL, NULL, 0);
+    panel_set_files(&right_panel, NULL, NULL, 0);
+    left_panel.selected_index = left_panel.scroll_index = 0;
+
+    KeyFeed feed = {0};
+    feed.keys = entries - 1 < BENCH_CURSOR_KEYS ? entries - 1 : BENCH_CURSOR_KEYS;
+    feed.bytes = __atomic_load_n(&pty_bytes, __ATOMIC_SEQ_CST);
+    pthread_t feeder;
+    pthread_create(&feeder, NULL, feed_keys, &feed);
+
+    char *argv[] = {"mc", NULL};
+    optind = 1;
+    mc_main(1, argv);
+    double key_ms = elapsed_ms(&feed.start);
+    pthread_join(feeder, NULL);
+    win1 = win2 = NULL;  // deleted by mc's cleanup()
+
+    int keys = feed.keys > 0 ? feed.keys : 1;
+    report(fixture, entries, "cursor_key", key_ms / keys, "ms");
+    report(fixture, entries, "cursor_key_bytes", (double)(pty_wait_quiet(feed.bytes, 50) - feed.bytes) / keys, "bytes");
+}
+
+
+int main(int argc, char *argv[]) {
+    int sizes[16] = {10000, 100000, 1000000};
+    int num_sizes = 3;
+    char root[CMD_MAX];
+    char path[CMD_MAX];
+    char fixture[64];
+
+    if (argc > 1) {
+        num_sizes = 0;
+        for (int i = 1; i < argc && num_sizes < 16; i++) {
+            sizes[num_sizes++] = atoi(argv[i]);
+        }
+    }
+
+    if (pty_open() != 0) {
+        fprintf(stderr, "bench: cannot open a pseudo terminal\n");
+        return 1;
+    }
+
+    uname(&unameData);
+    pw = getpwuid(getuid());
+    username = pw->pw_name;
+
+    const char *tmp = getenv("TMPDIR");
+    snprintf(root, sizeof(root), "%s/mc-bench-XXXXXX", tmp ? tmp : "/tmp");
+    if (mkdtemp(root) == NULL) {
+        fprintf(stderr, "bench: cannot create %s\n", root);
+        return 1;
+    }
+
+    printf("# fixture\tentries\tmetric\tvalue\tunit\n");
+
+    for (int i = 0; i < num_sizes; i++) {
+        fprintf(stderr, "bench: creating %d entries\n", sizes[i]);
+        snprintf(path, sizeof(path), "%s/flat_%d", root, sizes[i]);
+        mkdir(path, 0755);
+        create_entries(path, sizes[i]);
+        snprintf(fixture, sizeof(fixture), "flat_%d", sizes[i]);
+        bench_directory(fixture, path);
+    }
+
+    // the same entries at the bottom of a long path
+    snprintf(path, sizeof(path), "%s/deep", root);
+    mkdir(path, 0755);
+    for (int level = 0; level < BENCH_DEEP_LEVELS; level++) {
+        snprintf(path + strlen(path), sizeof(path) - strlen(path), "/level_%02d_%050d", level, 0);
+        mkdir(path, 0755);
+    }
+    create_entries(path, BENCH_DEEP_ENTRIES);
+    snprintf(fixture, sizeof(fixture), "deep_%d", BENCH_DEEP_ENTRIES);
+    bench_directory(fixture, path);
+
+    fprintf(stderr, "bench: removing fixtures\n");
+    chdir("/");
+    nftw(root, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+    return bench_failed;
+}
@@ -15,10 +15,12 @@ void update_cmd() {
     // Print username, hostname, and current directory path
     move(LINES - 2, 0);
     clrtoeol();
-    printw("%s@%s:%s# ", username, unameData.nodename, active_panel->path);
+    char jobs[64];
+    jobs_status(jobs, sizeof(jobs));
+    printw("%s%s@%s:%s# ", jobs, username, unameData.nodename, active_panel->path);
 
     // Calculate max command display length
-    prompt_length = strlen(username) + strlen(unameData.nodename) + strlen(active_panel->path) + 4;  // 5 accounts for '@', ':', '#', and spaces.
+    prompt_length = strlen(jobs) + strlen(username) + strlen(unameData.nodename) + strlen(active_panel->path) + 4;  // 5 accounts for '@', ':', '#', and spaces.
     int max_cmd_display = COLS - prompt_length;
 
     // Print the visible part of the command, limited to max_cmd_display characters
@@ -26,8 +28,8 @@ void update_cmd() {
 
     cursor_to_cmd();
 
-    // Refresh only the changed parts
-    refresh();
+    // the frame is written out by the caller's doupdate()
+    wnoutrefresh(stdscr);
 
     return;
 }
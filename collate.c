@@ -0,0 +1,119 @@
+#include "includes.h"
+#include "types.h"
+#include "globals.h"
+
+// Collation keys for the name sort modes other than plain byte order. A key is a string which
+// compares with strcmp() the way the mode orders names, so sorting compares bytes instead of
+// parsing names again on every comparison. A listing caches the keys of one mode.
+// Every key ends with "\1" and the name itself, which keeps keys unique: "a" and "A" fold to
+// the same text, "1" and "01" to the same number.
+
+#define COLLATE_TIE '\1'  // sorts below every other byte of a key
+
+
+// Digit runs become '0', the count of their significant digits + 1 and those digits,
+// a longer number then sorts after a shorter one, and '0' keeps digits before letters
+static size_t collate_natural(const char *name, char *key, size_t size) {
+    size_t len = 0;
+
+    while (*name && len + 3 < size) {
+        if (!isdigit((unsigned char) *name)) {
+            key[len++] = *name++;
+            continue;
+        }
+
+        while (*name == '0' && isdigit((unsigned char) name[1])) name++;  // leading zeros
+        size_t digits = 0;
+        while (isdigit((unsigned char) name[digits]) && digits < 254) digits++;
+        if (len + 2 + digits >= size) break;
+
+        key[len++] = '0';
+        key[len++] = (char) (digits + 1);
+        memcpy(key + len, name, digits);
+        len += digits;
+        name += digits;
+    }
+    return len;
+}
+
+
+static size_t collate_nocase(const char *name, char *key, size_t size) {
+    size_t len = 0;
+    while (*name && len + 1 < size) key[len++] = tolower((unsigned char) *name++);
+    return len;
+}
+
+
+static size_t collate_locale(const char *name, char *key, size_t size) {
+    size_t len = strxfrm(key, name, size);
+    if (len < size) return len;
+    return collate_nocase(name, key, size);  // does not fit, unlikely for a single name
+}
+
+
+static size_t collate_extension(const char *name, char *key, size_t size) {
+    const char *dot = strrchr(name, '.');
+    if (dot == NULL || dot == name) return 0;  // no extension, or a dot file like .profile
+
+    size_t len = strlen(dot + 1);
+    if (len >= size) len = size - 1;
+    memcpy(key, dot + 1, len);
+    return len;
+}
+
+
+// Build the key of 'name' for sort kind 'kind' into 'key', which has room for 'size' bytes
+const char *collate_key(SortKinds kind, const char *name, char *key, size_t size) {
+    size_t len = 0;
+
+    switch (kind) {
+        case SORT_NATURAL:
+            len = collate_natural(name, key, size);
+            break;
+        case SORT_NOCASE:
+            len = collate_nocase(name, key, size);
+            break;
+        case SORT_LOCALE:
+            len = collate_locale(name, key, size);
+            break;
+        case SORT_EXTENSION:
+            len = collate_extension(name, key, size);
+            break;
+        default:
+            return name;
+    }
+
+    snprintf(key + len, size - len, "%c%s", COLLATE_TIE, name);
+    return key;
+}
+
+
+// Compute the keys of kind 'kind' which are missing in the listing's cache.
+// Keys of another kind are dropped, their memory goes at once with the arena.
+void file_list_collate(FileList *list, SortKinds kind) {
+    if (list->collation == NULL || list->collation_kind != kind) {
+        arena_free(list->collation_arena);
+        list->collation_arena = NULL;
+        free(list->collation);
+        list->collation = calloc(list->capacity ? list->capacity : 1, sizeof(char *));
+        list->collation_kind = kind;
+    }
+
+    char key[CMD_MAX];
+    for (int i = 0; i < list->count; i++) {
+        if (list->collation[i] != NULL) continue;
+
+        const char *built = collate_key(kind, list->nodes[i].name, key, sizeof(key));
+        size_t len = strlen(built) + 1;
+        list->collation[i] = memcpy(arena_alloc(&list->collation_arena, len), built, len);
+    }
+}
+
+
+// Key of entry 'node_index', from the cache when it holds the kind, otherwise built into 'key'
+const char *file_list_collation(FileList *list, int node_index, SortKinds kind, char *key, size_t size) {
+    if (list->collation != NULL && list->collation_kind == kind && list->collation[node_index] != NULL) {
+        return list->collation[node_index];
+    }
+    return collate_key(kind, list->nodes[node_index].name, key, size);
+}
@@ -0,0 +1,137 @@
+#include "includes.h"
+#include "types.h"
+#include "globals.h"
+
+// Colours of entries in the panels, chosen by rules on the name or the mode. The rules are compiled
+// once: extensions go into a hash table keyed on the lowercase extension, glob patterns and mode bits
+// are checked in order. scan_entry() stores the number of the first matching rule in the node,
+// so drawing a row needs no matching at all. Name rules do not apply to directories.
+
+typedef enum {
+    COLOR_RULE_EXTENSION,  // 'match' lists extensions without the dot, separated by spaces
+    COLOR_RULE_GLOB,       // 'match' is a fnmatch() pattern for the whole name
+    COLOR_RULE_MODE        // all permission bits in 'mode' are set, like S_ISUID
+} ColorRuleKind;
+
+typedef struct ColorRule {
+    ColorRuleKind kind;
+    const char *match;
+    mode_t mode;
+    int color_pair;
+    int is_bold;
+} ColorRule;
+
+// Earlier rules win. At most 31, a node has 5 bits for its rule.
+static const ColorRule color_rules[] = {
+    {COLOR_RULE_EXTENSION, "gz tar xz", 0, COLOR_MAGENTA_ON_BLUE, 1},
+    {COLOR_RULE_EXTENSION, "c php sh h", 0, COLOR_CYAN_ON_BLUE, 0},
+};
+
+#define COLOR_RULES_COUNT (int) (sizeof(color_rules) / sizeof(color_rules[0]))
+#define COLOR_EXTENSION_MAX 16  // longer extensions can't be in the table
+
+typedef struct ColorExtension {
+    char extension[COLOR_EXTENSION_MAX + 1];  // empty for a free slot
+    int color;  // rule index + 1
+} ColorExtension;
+
+static ColorExtension *color_extensions;
+static unsigned int color_extensions_mask;
+static pthread_once_t color_rules_once = PTHREAD_ONCE_INIT;
+
+
+static unsigned int color_extension_hash(const char *extension) {
+    unsigned int hash = 2166136261u;  // FNV-1a
+    while (*extension) {
+        hash ^= (unsigned char)*extension++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+static void color_extension_add(const char *extension, int length, int color) {
+    char key[COLOR_EXTENSION_MAX + 1];
+    if (length == 0 || length > COLOR_EXTENSION_MAX) return;
+    for (int i = 0; i < length; i++) key[i] = tolower((unsigned char) extension[i]);
+    key[length] = '\0';
+
+    unsigned int slot = color_extension_hash(key) & color_extensions_mask;
+    while (color_extensions[slot].extension[0]) {
+        if (strcmp(color_extensions[slot].extension, key) == 0) return;  // an earlier rule has it
+        slot = (slot + 1) & color_extensions_mask;
+    }
+    snprintf(color_extensions[slot].extension, sizeof(color_extensions[slot].extension), "%s", key);
+    color_extensions[slot].color = color;
+}
+
+
+// Put the extensions of all rules in a table which stays at most half full
+static void color_rules_compile() {
+    int extensions = 0;
+    for (int i = 0; i < COLOR_RULES_COUNT; i++) {
+        if (color_rules[i].kind != COLOR_RULE_EXTENSION) continue;
+        for (const char *p = color_rules[i].match; *p; p++) {
+            if (*p != ' ' && (p == color_rules[i].match || p[-1] == ' ')) extensions++;
+        }
+    }
+
+    unsigned int size = 16;
+    while (size < extensions * 2) size *= 2;
+    color_extensions = calloc(size, sizeof(ColorExtension));
+    color_extensions_mask = size - 1;
+
+    for (int i = 0; i < COLOR_RULES_COUNT; i++) {
+        if (color_rules[i].kind != COLOR_RULE_EXTENSION) continue;
+        const char *p = color_rules[i].match;
+        while (*p) {
+            int length = strcspn(p, " ");
+            color_extension_add(p, length, i + 1);
+            p += length;
+            p += strspn(p, " ");
+        }
+    }
+}
+
+
+// Rule colouring an entry with 'name' and 'mode', rule index + 1, or 0 if none applies
+int file_color_class(const char *name, mode_t mode, int is_dir) {
+    pthread_once(&color_rules_once, color_rules_compile);
+
+    int color = 0;
+    if (!is_dir) {
+        // the part after the last dot, a name like ".sh" counts as extension too
+        const char *dot = strrchr(name, '.');
+        size_t length = dot ? strlen(dot + 1) : 0;
+        if (length > 0 && length <= COLOR_EXTENSION_MAX) {
+            char key[COLOR_EXTENSION_MAX + 1];
+            for (size_t i = 0; i <= length; i++) key[i] = tolower((unsigned char) dot[1 + i]);
+
+            unsigned int slot = color_extension_hash(key) & color_extensions_mask;
+            while (color_extensions[slot].extension[0]) {
+                if (strcmp(color_extensions[slot].extension, key) == 0) {
+                    color = color_extensions[slot].color;
+                    break;
+                }
+                slot = (slot + 1) & color_extensions_mask;
+            }
+        }
+    }
+
+    // rules before the extension's one still win
+    int until = color ? color - 1 : COLOR_RULES_COUNT;
+    for (int i = 0; i < until; i++) {
+        const ColorRule *rule = &color_rules[i];
+        if (rule->kind == COLOR_RULE_GLOB && !is_dir && fnmatch(rule->match, name, 0) == 0) return i + 1;
+        if (rule->kind == COLOR_RULE_MODE && (mode & rule->mode) == rule->mode) return i + 1;
+    }
+    return color;
+}
+
+
+// Attributes for wattron() of colour class 'color', 0 for the default colour
+int file_color_attrs(int color) {
+    if (color <= 0 || color > COLOR_RULES_COUNT) return 0;
+    const ColorRule *rule = &color_rules[color - 1];
+    return COLOR_PAIR(rule->color_pair) | (rule->is_bold ? A_BOLD : 0);
+}
@@ -0,0 +1,156 @@
+#include "includes.h"
+#include "types.h"
+#include "globals.h"
+
+// Listings of recently left directories, so going back with ".." does not read them again.
+// An entry is valid while its directory has the same device, inode, mtime and ctime. Entries
+// also keep their inotify watch, any event in the directory drops the entry, which catches
+// files changed in place (those do not touch the directory's mtime).
+
+typedef struct DirCacheEntry {
+    DirKey key;
+    FileList *files;
+    int *order;  // view of the panel which left the directory
+    int count;   // rows of the view
+    SortOrders sort_order;
+    char *filter;  // filter the view was built with
+    FilterKinds filter_by;
+    int watch_wd;
+    unsigned long last_used;  // 0 for an empty slot
+} DirCacheEntry;
+
+static DirCacheEntry dir_cache[DIR_CACHE_SIZE];
+static unsigned long dir_cache_clock = 0;
+
+
+int dir_key_read(int dir_fd, DirKey *key) {
+    struct stat st;
+    if (fstat(dir_fd, &st) != 0) return -1;
+
+    key->dev = st.st_dev;
+    key->ino = st.st_ino;
+    key->mtime = st.st_mtim;
+    key->ctime = st.st_ctim;
+    return 0;
+}
+
+
+int dir_key_equal(DirKey *a, DirKey *b) {
+    return a->dev == b->dev && a->ino == b->ino &&
+           a->mtime.tv_sec == b->mtime.tv_sec && a->mtime.tv_nsec == b->mtime.tv_nsec &&
+           a->ctime.tv_sec == b->ctime.tv_sec && a->ctime.tv_nsec == b->ctime.tv_nsec;
+}
+
+
+// Returns 1 if some cached listing still relies on the inotify watch 'wd'
+int dir_cache_uses_watch(int wd) {
+    for (int i = 0; i < DIR_CACHE_SIZE; i++) {
+        if (dir_cache[i].last_used && dir_cache[i].watch_wd == wd) return 1;
+    }
+    return 0;
+}
+
+
+static void dir_cache_drop(DirCacheEntry *entry) {
+    int wd = entry->watch_wd;
+
+    file_list_release(entry->files);
+    free(entry->order);
+    free(entry->filter);
+    memset(entry, 0, sizeof(DirCacheEntry));
+    if (wd > 0) watch_release(wd);
+}
+
+
+// Something changed in a watched directory, forget its cached listing.
+// wd 0 means events were lost, nothing cached can be trusted then.
+void dir_cache_invalidate_watch(int wd) {
+    for (int i = 0; i < DIR_CACHE_SIZE; i++) {
+        if (dir_cache[i].last_used && (wd == 0 || dir_cache[i].watch_wd == wd)) dir_cache_drop(&dir_cache[i]);
+    }
+}
+
+
+// Panel is about to leave its directory, keep the listing instead of freeing it.
+// The panel is left empty. Listings with unapplied changes are not worth keeping.
+void dir_cache_store(PanelProp *panel) {
+    watch_read_events();
+
+    FileList *files = panel->files;
+    int *order = panel->order;
+    int count = panel->files_count;
+    int keep = files != NULL && order != NULL && !panel->watch_rescan && panel->watch_pending_count == 0 && !panel->loading && !panel->incomplete;
+    panel->files = NULL;
+    panel->order = NULL;
+    panel_set_files(panel, NULL, NULL, 0);
+
+    if (!keep) {
+        file_list_release(files);
+        free(order);
+        return;
+    }
+
+    DirCacheEntry *slot = &dir_cache[0];
+    for (int i = 0; i < DIR_CACHE_SIZE; i++) {
+        if (dir_cache[i].last_used && dir_cache[i].key.dev == panel->dir_key.dev && dir_cache[i].key.ino == panel->dir_key.ino) {
+            slot = &dir_cache[i];  // older listing of the same directory
+            break;
+        }
+        if (dir_cache[i].last_used < slot->last_used) slot = &dir_cache[i];  // free or least recently used
+    }
+
+    if (slot->last_used) dir_cache_drop(slot);
+
+    slot->key = panel->dir_key;
+    slot->files = files;
+    slot->order = order;
+    slot->count = count;
+    slot->sort_order = panel->sort_order;
+    slot->filter = panel->filter ? strdup(panel->filter) : NULL;
+    slot->filter_by = panel->filter_by;
+    slot->watch_wd = panel->watch_wd;
+    slot->last_used = ++dir_cache_clock;
+}
+
+
+// Give the panel the cached listing of panel->path if the directory did not change since.
+// Returns 1 on success, 0 if the directory has to be read.
+int dir_cache_restore(PanelProp *panel) {
+    watch_read_events();
+
+    int dir_fd = open(panel->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1) return 0;
+
+    DirKey key;
+    int ret = dir_key_read(dir_fd, &key);
+    close(dir_fd);
+    if (ret != 0) return 0;
+
+    for (int i = 0; i < DIR_CACHE_SIZE; i++) {
+        DirCacheEntry *entry = &dir_cache[i];
+        if (!entry->last_used || !dir_key_equal(&entry->key, &key)) continue;
+
+        // read for another sort order, the listing may lack what this one sorts by
+        int fields = scan_fields_for_panel(panel);
+        if ((entry->files->fields & fields) != fields) continue;
+
+        // selection does not survive leaving a directory, the panel's view starts empty
+        if (entry->sort_order == panel->sort_order && panel_filter_equal(panel, entry->filter, entry->filter_by)) {
+            panel_set_files(panel, entry->files, entry->order, entry->count);
+        } else {
+            panel_set_files(panel, entry->files, NULL, 0);
+            sort_panel_files(panel);
+            free(entry->order);
+        }
+        panel->dir_key = key;
+
+        entry->files = NULL;
+        entry->order = NULL;
+        entry->last_used = 0;
+        panel_watch(panel);  // takes over the entry's watch, inotify hands out the same descriptor
+        dir_cache_drop(entry);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+#include "includes.h"
+#include "types.h"
+#include "globals.h"
+
+// The main loop waits in a single poll() on the terminal and on every registered event source:
+// the inotify queue, timerfds, background jobs' terminals and pidfds. Whatever became ready is
+// dispatched to its handler, a key ends the wait. Handlers run on the main thread between keys,
+// so they can touch panels and windows freely.
+
+typedef struct EventSource {
+    int fd;
+    EventHandler handler;
+    void *arg;
+    unsigned id;  // tells a source apart from a later one with the same fd
+} EventSource;
+
+static EventSource event_sources[EVENT_SOURCES_MAX];
+static int event_source_count = 0;
+static unsigned event_source_next_id = 0;
+
+static int frame_timer_fd = -1;
+static struct timeval last_frame = {0};
+static int frame_dirty = 1;  // keys were handled or handlers changed something since the last frame
+
+
+// Call 'handler' whenever 'fd' is readable. Returns -1 if there are too many sources.
+int event_add(int fd, EventHandler handler, void *arg) {
+    if (event_source_count == EVENT_SOURCES_MAX) return -1;
+    event_sources[event_source_count++] = (EventSource) {fd, handler, arg, ++event_source_next_id};
+    return 0;
+}
+
+
+void event_remove(int fd) {
+    for (int i = 0; i < event_source_count; i++) {
+        if (event_sources[i].fd != fd) continue;
+        event_sources[i] = event_sources[--event_source_count];
+        return;
+    }
+}
+
+
+// Timer calling 'handler' once it expires, it starts disarmed. Returns its fd, -1 on failure.
+int event_timer_new(EventHandler handler, void *arg) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) return -1;
+    if (event_add(fd, handler, arg) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+// Let the timer expire once in 'ms' milliseconds, or never with a negative value
+void event_timer_set(int fd, int ms) {
+    if (fd == -1) return;
+
+    struct itimerspec spec = {0};
+    if (ms >= 0) {
+        spec.it_value.tv_sec = ms / 1000;
+        spec.it_value.tv_nsec = (ms % 1000) * 1000000L + 1;  // all zero would disarm it
+    }
+    timerfd_settime(fd, 0, &spec, NULL);
+}
+
+
+// Acknowledge an expired timer, so poll() stops reporting it
+void event_consume(int fd) {
+    uint64_t count;
+    while (read(fd, &count, sizeof(count)) > 0) {}
+}
+
+
+// Something on screen changed outside of key handling, draw a frame when the frame rate allows
+void event_request_frame() {
+    frame_dirty = 1;
+}
+
+
+// Milliseconds until the next frame may be drawn, so no more than frame_rate are drawn per second
+static int frame_wait_ms() {
+    if (frame_rate <= 0) return 0;
+
+    struct timeval now, diff;
+    gettimeofday(&now, NULL);
+    timersub(&now, &last_frame, &diff);
+    long elapsed_ms = diff.tv_sec * 1000 + diff.tv_usec / 1000;
+    long interval_ms = 1000 / frame_rate;
+
+    return elapsed_ms >= interval_ms ? 0 : interval_ms - elapsed_ms;
+}
+
+
+// Compose the panels and the command line, then write what changed to the terminal at once.
+// The command line comes last, so the terminal cursor ends up there.
+static void draw_panels() {
+    update_panel(win1, &left_panel);
+    update_panel(win2, &right_panel);
+    update_cmd();
+}
+
+
+static void draw_frame(void (*draw)(void)) {
+    draw();
+    doupdate();
+    gettimeofday(&last_frame, NULL);
+    frame_dirty = 0;
+}
+
+
+// the frame timer only wakes up poll(), the loop draws
+static void frame_timer_expired(int fd, void *arg) {
+    event_consume(fd);
+}
+
+
+// The source is still registered, no handler removed it meanwhile
+static int event_source_live(unsigned id) {
+    for (int i = 0; i < event_source_count; i++) {
+        if (event_sources[i].id == id) return 1;
+    }
+    return 0;
+}
+
+
+// Wait until the terminal or a registered source is ready and dispatch the sources which are.
+// Sources a handler removed during the round are skipped, their fd may be closed or reused.
+// Returns after one round, with the terminal possibly readable.
+static void event_dispatch() {
+    struct pollfd fds[EVENT_SOURCES_MAX + 1];
+    EventSource sources[EVENT_SOURCES_MAX];  // handlers may add and remove sources meanwhile
+    int count = event_source_count;
+    memcpy(sources, event_sources, count * sizeof(EventSource));
+
+    fds[0] = (struct pollfd) { .fd = STDIN_FILENO, .events = POLLIN };
+    for (int i = 0; i < count; i++) {
+        fds[1 + i] = (struct pollfd) { .fd = sources[i].fd, .events = POLLIN };
+    }
+
+    if (poll(fds, count + 1, -1) <= 0) return;  // interrupted, by SIGWINCH for one
+
+    for (int i = 0; i < count; i++) {
+        if (!(fds[1 + i].revents & (POLLIN | POLLERR | POLLHUP)) || !event_source_live(sources[i].id)) continue;
+        sources[i].handler(sources[i].fd, sources[i].arg);
+    }
+}
+
+
+// Wait for a key press and dispatch events meanwhile, calling 'draw' to compose a frame when
+// something changed. Keys which are already typed ahead are returned without drawing, so a burst
+// of them is handled at once and shows in a single frame, except when the burst lasts longer
+// than a frame interval.
+int event_wait_key(void (*draw)(void)) {
+    if (frame_timer_fd == -1) frame_timer_fd = event_timer_new(frame_timer_expired, NULL);
+
+    while (1) {
+        // ncurses may already hold typed ahead characters which poll() would not see
+        timeout(0);
+        int ch = getch();
+        timeout(-1);
+        if (ch != ERR) {
+            if (frame_dirty && frame_wait_ms() == 0) draw_frame(draw);
+            frame_dirty = 1;  // the caller handles the key
+            return ch;
+        }
+
+        // nothing typed, the frame is drawn as soon as the frame rate allows
+        if (frame_dirty) {
+            int frame_wait = frame_wait_ms();
+            if (frame_wait == 0 || frame_timer_fd == -1) {
+                draw_frame(draw);
+                continue;
+            }
+            event_timer_set(frame_timer_fd, frame_wait);
+        }
+
+        event_dispatch();
+    }
+}
+
+
+// Wait for a key press on the panels
+int wait_for_key() {
+    return event_wait_key(draw_panels);
+}
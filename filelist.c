@@ -2,36 +2,64 @@
 #include "types.h"
 #include "globals.h"
 
-int compare_nodes(FileNode *a, FileNode *b, SortOrders sort_order) {
+int incremental_sorts = 0;  // refreshes sorted by patching the previous view, the benchmark checks it
+
+static int is_updir(const char *name) {
+    return name[0] == '.' && name[1] == '.' && name[2] == '\0';
+}
+
+
+SortKinds sort_kind(SortOrders sort_order) {
+    if (sort_order >= SORT_BY_NATURAL_DIRSFIRST_ASC) return SORT_NATURAL + (sort_order - SORT_BY_NATURAL_DIRSFIRST_ASC) / 2;
+    return sort_order % 3;  // 3 basic sort types, ascending then descending, mixed then dirs first
+}
+
+
+int sort_descending(SortOrders sort_order) {
+    if (sort_order >= SORT_BY_NATURAL_DIRSFIRST_ASC) return (sort_order - SORT_BY_NATURAL_DIRSFIRST_ASC) % 2;
+    return sort_order % 6 >= SORT_BY_NAME_DESC;
+}
+
+
+int sort_dirs_first(SortOrders sort_order) {
+    return sort_order >= SORT_BY_NAME_DIRSFIRST_ASC;
+}
+
+
+// Order of entries 'a' and 'b' of 'list', <0 if a comes first
+int compare_nodes(FileList *list, int a, int b, SortOrders sort_order) {
+    FileNode *node_a = &list->nodes[a], *node_b = &list->nodes[b];
+    SortKinds kind = sort_kind(sort_order);
     int result = 0;
-    int dirs_first = sort_order >= SORT_BY_NAME_DIRSFIRST_ASC;
 
     // Check if either node is ".."
-    if (strcmp(a->name, "..") == 0) return -1;
-    if (strcmp(b->name, "..") == 0) return 1;
+    if (is_updir(node_a->name)) return -1;
+    if (is_updir(node_b->name)) return 1;
 
-    if (dirs_first && (a->is_dir != b->is_dir)) {
-        return a->is_dir ? -1 : 1;
+    if (sort_dirs_first(sort_order) && (node_a->is_dir != node_b->is_dir)) {
+        return node_a->is_dir ? -1 : 1;
     }
 
-    switch (sort_order % 6) {  // 6 because there are 6 basic sort types
-        case SORT_BY_NAME_ASC:
-        case SORT_BY_NAME_DESC:
-            result = strcmp(a->name, b->name);
+    switch (kind) {
+        case SORT_NAME:
+            result = strcmp(node_a->name, node_b->name);
+            break;
+        case SORT_SIZE:
+            result = (node_a->size > node_b->size) - (node_a->size < node_b->size);
             break;
-        case SORT_BY_SIZE_ASC:
-        case SORT_BY_SIZE_DESC:
-            result = (a->size > b->size) - (a->size < b->size);
+        case SORT_TIME:
+            result = (node_a->mtime > node_b->mtime) - (node_a->mtime < node_b->mtime);
             break;
-        case SORT_BY_TIME_ASC:
-        case SORT_BY_TIME_DESC:
-            result = (a->mtime > b->mtime) - (a->mtime < b->mtime);
+        default: {
+            char key_a[CMD_MAX], key_b[CMD_MAX];
+            result = strcmp(file_list_collation(list, a, kind, key_a, sizeof(key_a)),
+                            file_list_collation(list, b, kind, key_b, sizeof(key_b)));
             break;
+        }
     }
 
     // DESC sort? revert result
-    if (sort_order == SORT_BY_NAME_DESC || sort_order == SORT_BY_SIZE_DESC || sort_order == SORT_BY_TIME_DESC ||
-        sort_order == SORT_BY_NAME_DIRSFIRST_DESC || sort_order == SORT_BY_SIZE_DIRSFIRST_DESC || sort_order == SORT_BY_TIME_DIRSFIRST_DESC) {
+    if (sort_descending(sort_order)) {
         result = -result;
     }
 
@@ -39,133 +67,1254 @@ int compare_nodes(FileNode *a, FileNode *b, SortOrders sort_order) {
 }
 
 
-void sort_file_nodes(FileNode **head_ref, SortOrders sort_order) {
-    FileNode *sorted = NULL;
-    FileNode *current = *head_ref;
+// Make room for 'count' entries in the panel's view
+static void panel_view_reserve(PanelProp *panel, int count) {
+    if (count <= panel->view_capacity) return;
+
+    int capacity = panel->view_capacity ? panel->view_capacity : 64;
+    while (capacity < count) capacity *= 2;
+    int used = (panel->view_capacity + 7) / 8;
+
+    panel->order = realloc(panel->order, capacity * sizeof(int));
+    panel->selected = realloc(panel->selected, (capacity + 7) / 8);
+    memset(panel->selected + used, 0, (capacity + 7) / 8 - used);
+    panel->view_capacity = capacity;
+}
+
+
+static inline int sort_key_less(const SortKey *a, const SortKey *b) {
+    if (a->group != b->group) return a->group < b->group;
+    if (a->value != b->value) return a->value < b->value;
+    return a->node < b->node;  // equal sizes or times keep directory order
+}
+
+
+static void sort_keys_insertion(SortKey *keys, int count) {
+    for (int i = 1; i < count; i++) {
+        SortKey current = keys[i];
+        int j = i;
+        while (j > 0 && sort_key_less(&current, &keys[j - 1])) {
+            keys[j] = keys[j - 1];
+            j--;
+        }
+        keys[j] = current;
+    }
+}
+
+
+// Stable LSD radix sort by group and value, one byte per pass, tmp is scratch space of the
+// same size. Bytes which are the same in all keys are skipped, so names sharing a prefix,
+// small sizes or times close to each other take only a few passes.
+static void sort_keys(SortKey *keys, SortKey *tmp, int count) {
+    if (count <= SORT_INSERTION_RUN) {
+        sort_keys_insertion(keys, count);
+        return;
+    }
+
+    int counts[9][256] = {{0}};  // pass 0 to 7 are the bytes of value, lowest first, 8 the group
+    for (int i = 0; i < count; i++) {
+        uint64_t value = keys[i].value;
+        for (int pass = 0; pass < 8; pass++) {
+            counts[pass][(value >> (8 * pass)) & 0xff]++;
+        }
+        counts[8][keys[i].group]++;
+    }
+
+    SortKey *src = keys, *dst = tmp;
+    for (int pass = 0; pass < 9; pass++) {
+        int shift = 8 * pass;
+        int first = pass < 8 ? (src[0].value >> shift) & 0xff : src[0].group;
+        if (counts[pass][first] == count) continue;
+
+        int offsets[256];
+        for (int digit = 0, offset = 0; digit < 256; digit++) {
+            offsets[digit] = offset;
+            offset += counts[pass][digit];
+        }
+        for (int i = 0; i < count; i++) {
+            int digit = pass < 8 ? (src[i].value >> shift) & 0xff : src[i].group;
+            dst[offsets[digit]++] = src[i];
+        }
+
+        SortKey *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != keys) memcpy(keys, src, count * sizeof(SortKey));
+}
+
+
+// 8 bytes of a name as a big endian number, compares like strcmp() does. Shorter names are padded with 0.
+static uint64_t name_prefix(const char *name, int descending) {
+    uint64_t prefix = 0;
+    int i = 0;
+    for (; i < 8 && name[i]; i++) prefix = (prefix << 8) | (unsigned char) name[i];
+    if (i > 0 && i < 8) prefix <<= 8 * (8 - i);  // an empty name stays 0, shifting by 64 is undefined
+    return descending ? ~prefix : prefix;
+}
+
+
+// Bytes from 'depth' on which all names of the keys have in common
+static int names_common_prefix(SortKey *keys, int count, int depth, char **names) {
+    const char *first = names[keys[0].node] + depth;
+    int shared = strlen(first);
+
+    for (int i = 1; i < count && shared > 0; i++) {
+        const char *name = names[keys[i].node] + depth;
+        int n = 0;
+        while (n < shared && name[n] == first[n]) n++;
+        shared = n;
+    }
+    return shared;
+}
 
-    while (current != NULL) {
-        FileNode *next = current->next;
 
-        if (sorted == NULL || compare_nodes(current, sorted, sort_order) <= 0) {
-            current->next = sorted;
-            sorted = current;
+// Names which are equal in their first 'depth' bytes are sorted again by the next 8 bytes,
+// until every run of equal keys is a single entry. Most names differ within 16 bytes.
+static void sort_keys_refine(SortKey *keys, SortKey *tmp, int count, int depth, char **names, int descending) {
+    int start = 0;
+
+    while (start < count) {
+        int end = start + 1;
+        while (end < count && keys[end].group == keys[start].group && keys[end].value == keys[start].value) end++;
+
+        // a NUL in the compared bytes means the name ended there, names are unique so this cannot repeat
+        uint64_t last = descending ? ~keys[start].value : keys[start].value;
+        if (end - start > 1 && (last & 0xff) != 0) {
+            int run_depth = depth, same = 1;
+            for (int i = start; i < end; i++) {
+                keys[i].value = depth == 8 ? keys[i].next : name_prefix(names[keys[i].node] + depth, descending);
+                same &= keys[i].value == keys[start].value;
+            }
+
+            // long shared prefixes are skipped at once instead of taking a pass per 8 bytes
+            if (same) {
+                run_depth += names_common_prefix(keys + start, end - start, depth, names);
+                for (int i = start; i < end; i++) {
+                    keys[i].value = name_prefix(names[keys[i].node] + run_depth, descending);
+                }
+            }
+
+            sort_keys(keys + start, tmp, end - start);
+            sort_keys_refine(keys + start, tmp, end - start, run_depth + 8, names, descending);
+        }
+        start = end;
+    }
+}
+
+
+// Big listings are sorted on several threads: each sorts a chunk of the keys, then the sorted
+// chunks are merged pairwise, every merge split among all threads at points found by binary search.
+
+typedef struct SortJob {
+    SortKey *keys;
+    SortKey *tmp;
+    int count;
+    int threads;    // a power of two, also the number of chunks
+    int thread;     // which one this job runs on
+    int span;       // chunks per run being merged in this round, 0 while sorting the chunks
+    char **names;   // NULL for size and time orders
+    int descending;
+} SortJob;
+
+
+// Total order of sorted keys, which need not be in the same refine state
+static inline int sort_key_before(const SortKey *a, const SortKey *b, const SortJob *job) {
+    if (a->group != b->group) return a->group < b->group;
+    if (a->value != b->value) return a->value < b->value;
+    if (a->next != b->next) return a->next < b->next;
+    if (job->names != NULL) {
+        // the first 16 bytes are equal and neither name ended within them
+        int result = strcmp(job->names[a->node] + 16, job->names[b->node] + 16);
+        return job->descending ? result > 0 : result < 0;
+    }
+    return a->node < b->node;
+}
+
+
+static int sort_chunk_start(const SortJob *job, int chunk) {
+    return (long) job->count * chunk / job->threads;
+}
+
+
+// Keys of a which are among the first 'diagonal' keys when merging a and b
+static int sort_merge_split(const SortKey *a, int a_count, const SortKey *b, int b_count, int diagonal, const SortJob *job) {
+    int low = diagonal > b_count ? diagonal - b_count : 0;
+    int high = diagonal < a_count ? diagonal : a_count;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (sort_key_before(&b[diagonal - middle - 1], &a[middle], job)) {
+            high = middle;
         } else {
-            FileNode *temp = sorted;
-            while (temp->next != NULL && compare_nodes(current, temp->next, sort_order) > 0) {
-                temp = temp->next;
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+
+static void *sort_thread(void *arg) {
+    SortJob *job = arg;
+
+    if (job->span == 0) {
+        int start = sort_chunk_start(job, job->thread);
+        int count = sort_chunk_start(job, job->thread + 1) - start;
+        SortKey *keys = job->keys + start;
+
+        sort_keys(keys, job->tmp + start, count);
+        if (job->names != NULL) {
+            sort_keys_refine(keys, job->tmp + start, count, 8, job->names, job->descending);
+            for (int i = 0; i < count; i++) {
+                keys[i].value = name_prefix(job->names[keys[i].node], job->descending);  // refine reused it
             }
-            current->next = temp->next;
-            temp->next = current;
         }
+        return NULL;
+    }
 
-        current = next;
+    // rounds alternate between the two buffers, the chunks were sorted in place
+    int round = __builtin_ctz(job->span);
+    SortKey *src = round % 2 ? job->tmp : job->keys;
+    SortKey *dst = round % 2 ? job->keys : job->tmp;
+
+    int parts = 2 * job->span;  // threads on one merge
+    int first_chunk = job->thread / parts * parts;
+    int part = job->thread % parts;
+
+    int a_start = sort_chunk_start(job, first_chunk);
+    int b_start = sort_chunk_start(job, first_chunk + job->span);
+    int end = sort_chunk_start(job, first_chunk + parts);
+    SortKey *a = src + a_start, *b = src + b_start;
+    int a_count = b_start - a_start, b_count = end - b_start;
+
+    int from = (long) (a_count + b_count) * part / parts;
+    int to = (long) (a_count + b_count) * (part + 1) / parts;
+    int a_from = sort_merge_split(a, a_count, b, b_count, from, job);
+    int a_to = sort_merge_split(a, a_count, b, b_count, to, job);
+
+    const SortKey *a_next = a + a_from, *a_end = a + a_to;
+    const SortKey *b_next = b + from - a_from, *b_end = b + to - a_to;
+    SortKey *out = dst + a_start + from;
+    while (a_next < a_end && b_next < b_end) {
+        *out++ = sort_key_before(b_next, a_next, job) ? *b_next++ : *a_next++;
     }
+    while (a_next < a_end) *out++ = *a_next++;
+    while (b_next < b_end) *out++ = *b_next++;
+    return NULL;
+}
+
 
-    *head_ref = sorted;
+static int sort_threads() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = 1;
+    while (threads * 2 <= cpus && threads * 2 <= SORT_MAX_THREADS) threads *= 2;
+    return threads;
 }
 
 
-int update_panel_files(PanelProp *panel) {
-    DIR *dir;
-    struct dirent *entry;
-    struct stat file_stat;
-    struct stat link_stat;
-    FileNode *head = NULL, *current = NULL, *original_head = NULL;
+// Sort keys with 'threads' threads, the result ends up in keys. Returns -1 if threads
+// could not be started, keys are left as they were then.
+static int sort_keys_parallel(SortKey *keys, SortKey *tmp, int count, int threads, char **names, int descending) {
+    pthread_t ids[SORT_MAX_THREADS];
+    SortJob jobs[SORT_MAX_THREADS];
+    int rounds = 0;
 
-    original_head = panel->files;
-    panel->files = NULL;
-    panel->files_count = 0;
+    for (int span = 0; span < threads; span = span ? span * 2 : 1) {
+        int started = 0;
+        for (int i = 0; i < threads; i++) {
+            jobs[i] = (SortJob) {keys, tmp, count, threads, i, span, names, descending};
+            if (pthread_create(&ids[i], NULL, sort_thread, &jobs[i]) != 0) break;
+            started++;
+        }
+        for (int i = 0; i < started; i++) {
+            pthread_join(ids[i], NULL);
+        }
+        if (started < threads) {
+            if (span == 0) return -1;
+            for (int i = started; i < threads; i++) sort_thread(&jobs[i]);  // finish the round here
+        }
+        if (span) rounds++;
+    }
+
+    if (rounds % 2) memcpy(keys, tmp, count * sizeof(SortKey));
+    return 0;
+}
+
+
+// Same order as compare_nodes(), but sorts precomputed keys instead of comparing nodes.
+// ".." is kept on the first row and does not take part in the sort. Entries the panel's filter
+// hides are left out, those it shows get what they are sorted by resolved if the scan skipped them.
+void sort_panel_files(PanelProp *panel) {
+    FileList *list = panel->files;
+    panel_view_reserve(panel, list->count);
+    int *order = panel->order;
+    SortKinds kind = sort_kind(panel->sort_order);
+    int dirs_first = sort_dirs_first(panel->sort_order);
+    int descending = sort_descending(panel->sort_order);
+    int by_name = kind != SORT_SIZE && kind != SORT_TIME;
+    char **names = NULL;  // what name sorts compare, the names or their collation keys
+
+    if (kind >= SORT_NATURAL) {
+        file_list_collate(list, kind);
+        names = list->collation;
+    } else if (by_name) {
+        names = malloc(list->count * sizeof(char *) + 1);
+        for (int i = 0; i < list->count; i++) names[i] = list->nodes[i].name;
+    }
+
+    SortKey *keys = malloc(2 * list->count * sizeof(SortKey) + 1);
+    int count = 0, pinned = 0;
+    int fields = scan_fields_for_panel(panel);
+    int dir_fd = -1;
+
+    for (int i = 0; i < list->count; i++) {
+        FileNode *node = &list->nodes[i];
+        if (is_updir(node->name)) {
+            order[pinned++] = i;
+            continue;
+        }
+        if (panel->filter != NULL && !panel_filter_shows(panel, node)) continue;
+        if ((node->resolved & fields) != fields) {
+            if (dir_fd == -1) dir_fd = open(panel->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dir_fd != -1) scan_entry(dir_fd, node->name, DT_UNKNOWN, fields | node->resolved, list, node);
+        }
+
+        SortKey *key = &keys[count++];
+        key->node = i;
+        key->group = dirs_first && !node->is_dir;
+        key->next = 0;
+        if (by_name) {
+            key->value = name_prefix(names[i], descending);
+            key->next = strnlen(names[i], 8) == 8 ? name_prefix(names[i] + 8, descending) : 0;
+        } else if (kind == SORT_SIZE) {
+            key->value = (uint64_t) node->size;
+        } else {
+            key->value = (uint64_t) node->mtime ^ (1ULL << 63);  // signed to unsigned order
+        }
+        if (descending && !by_name) key->value = ~key->value;
+    }
+
+    int threads = count >= SORT_PARALLEL_MIN ? sort_threads() : 1;
+    if (threads == 1 || sort_keys_parallel(keys, keys + count, count, threads, by_name ? names : NULL, descending) != 0) {
+        sort_keys(keys, keys + count, count);
+        if (by_name) sort_keys_refine(keys, keys + count, count, 8, names, descending);
+    }
+    if (names != list->collation) free(names);
+
+    for (int i = 0; i < count; i++) {
+        order[pinned + i] = keys[i].node;
+    }
+    free(keys);
+    if (dir_fd != -1) close(dir_fd);
+    panel->files_count = pinned + count;
+    panel->sorted_by = panel->sort_order;
+}
+
+
+// Entries of the listing sorted by their names in byte order, for finding names by prefix.
+// Kept until entries are added or removed.
+int *file_list_name_order(FileList *list) {
+    if (list->name_order != NULL) return list->name_order;
+
+    char **names = malloc(list->count * sizeof(char *) + 1);
+    SortKey *keys = malloc(2 * list->count * sizeof(SortKey) + 1);
+    for (int i = 0; i < list->count; i++) {
+        names[i] = list->nodes[i].name;
+        keys[i] = (SortKey) {name_prefix(names[i], 0), strnlen(names[i], 8) == 8 ? name_prefix(names[i] + 8, 0) : 0, 0, i};
+    }
+
+    int count = list->count;
+    int threads = count >= SORT_PARALLEL_MIN ? sort_threads() : 1;
+    if (threads == 1 || sort_keys_parallel(keys, keys + count, count, threads, names, 0) != 0) {
+        sort_keys(keys, keys + count, count);
+        sort_keys_refine(keys, keys + count, count, 8, names, 0);
+    }
+
+    list->name_order = malloc(count * sizeof(int) + 1);
+    for (int i = 0; i < count; i++) list->name_order[i] = keys[i].node;
+    free(keys);
+    free(names);
+    return list->name_order;
+}
+
+
+FileList *file_list_new() {
+    FileList *list = (FileList*) calloc(1, sizeof(FileList));
+    list->refs = 1;
+    return list;
+}
+
+
+FileList *file_list_retain(FileList *list) {
+    list->refs++;
+    return list;
+}
+
+
+// Free all blocks of an arena
+void arena_free(ArenaBlock *block) {
+    while (block != NULL) {
+        ArenaBlock *prev = block->prev;
+        free(block);
+        block = prev;
+    }
+}
+
+
+// Take 'len' bytes from the arena, a new block is started when the current one is full
+char *arena_alloc(ArenaBlock **arena, size_t len) {
+    ArenaBlock *block = *arena;
+
+    if (block == NULL || block->size - block->used < len) {
+        size_t size = len > ARENA_BLOCK_SIZE ? len : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(ArenaBlock) + size);
+        block->size = size;
+        block->used = 0;
+        block->prev = *arena;
+        *arena = block;
+    }
+
+    char *memory = block->data + block->used;
+    block->used += len;
+    return memory;
+}
+
+
+// Drop a reference, the last one frees the whole listing, including all names, in a few calls regardless of its size
+void file_list_release(FileList *list) {
+    if (list == NULL || --list->refs > 0) return;
+
+    arena_free(list->arena);
+    arena_free(list->collation_arena);
+    arena_free(list->display_arena);
+    free(list->nodes);
+    free(list->index);
+    free(list->collation);
+    free(list->display);
+    free(list->name_order);
+    free(list);
+}
+
+
+// Copy a string into the listing's arena, it lives as long as the listing
+char *file_list_strdup(FileList *list, const char *str) {
+    size_t len = strlen(str) + 1;
+    return memcpy(arena_alloc(&list->arena, len), str, len);
+}
+
+
+// Make room for 'more' nodes, so pointers into the array stay valid while they are added
+void file_list_reserve(FileList *list, int more) {
+    if (list->count + more <= list->capacity) return;
+
+    int capacity = list->capacity ? list->capacity : 64;
+    while (capacity < list->count + more) capacity *= 2;
+    list->nodes = realloc(list->nodes, capacity * sizeof(FileNode));
+    if (list->collation != NULL) {
+        list->collation = realloc(list->collation, capacity * sizeof(char *));
+        memset(list->collation + list->capacity, 0, (capacity - list->capacity) * sizeof(char *));
+    }
+    if (list->display != NULL) {
+        list->display = realloc(list->display, capacity * sizeof(EntryDisplay *));
+        memset(list->display + list->capacity, 0, (capacity - list->capacity) * sizeof(EntryDisplay *));
+    }
+    list->capacity = capacity;
+}
+
+
+static unsigned int name_hash(const char *name) {
+    unsigned int hash = 2166136261u;  // FNV-1a
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+// Bring the name index up to date, entries are appended to a listing without touching it.
+// The table is kept at most half full and rebuilt twice as big when it gets fuller.
+static void file_list_index(FileList *list) {
+    if (list->index == NULL || list->count * 2 > list->index_size) {
+        int size = 1024;
+        while (size < list->count * 2) size *= 2;
+        free(list->index);
+        list->index = calloc(size, sizeof(int));
+        list->index_size = size;
+        list->indexed = 0;
+    }
+
+    unsigned int mask = list->index_size - 1;
+    for (; list->indexed < list->count; list->indexed++) {
+        unsigned int slot = name_hash(list->nodes[list->indexed].name) & mask;
+        while (list->index[slot]) slot = (slot + 1) & mask;
+        list->index[slot] = list->indexed + 1;
+    }
+}
+
+
+// Slot of the index holding entry 'node_index', its name is 'name'
+static unsigned int file_list_slot(FileList *list, const char *name, int node_index) {
+    unsigned int mask = list->index_size - 1;
+    unsigned int slot = name_hash(name) & mask;
+    while (list->index[slot] != node_index + 1) slot = (slot + 1) & mask;
+    return slot;
+}
+
+
+// Index of the entry called 'name', -1 if there is none
+int file_list_find(FileList *list, const char *name) {
+    file_list_index(list);
+
+    unsigned int mask = list->index_size - 1;
+    for (unsigned int slot = name_hash(name) & mask; list->index[slot]; slot = (slot + 1) & mask) {
+        int node_index = list->index[slot] - 1;
+        if (strcmp(list->nodes[node_index].name, name) == 0) return node_index;
+    }
+    return -1;
+}
+
+
+// Take entry 'node_index' out of the index, entries after it in the probe sequence move back
+// so lookups never stop at the hole
+static void file_list_unindex(FileList *list, int node_index) {
+    unsigned int mask = list->index_size - 1;
+    unsigned int hole = file_list_slot(list, list->nodes[node_index].name, node_index);
+
+    for (unsigned int slot = (hole + 1) & mask; list->index[slot]; slot = (slot + 1) & mask) {
+        unsigned int home = name_hash(list->nodes[list->index[slot] - 1].name) & mask;
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            list->index[hole] = list->index[slot];
+            hole = slot;
+        }
+    }
+    list->index[hole] = 0;
+}
+
+
+// Panels whose view is built on 'list', returns how many
+static int file_list_views(FileList *list, PanelProp *views[2]) {
+    int count = 0;
+    if (left_panel.files == list) views[count++] = &left_panel;
+    if (right_panel.files == list) views[count++] = &right_panel;
+    return count;
+}
+
+
+// Order of entries like sort_panel_files() makes it, equal ones stay in directory order
+static int compare_entries(FileList *list, int a, int b, SortOrders sort_order) {
+    int result = compare_nodes(list, a, b, sort_order);
+    return result ? result : (a > b) - (a < b);
+}
+
+
+// Row of the sorted 'order' where entry 'node_index' belongs, searched from row 'low' on
+static int sorted_position(FileList *list, int *order, int count, int node_index, SortOrders sort_order, int low) {
+    int high = count;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (compare_entries(list, node_index, order[middle], sort_order) > 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+
+// Put entry 'node_index' to its sorted place in the view, returns the row it got,
+// or -1 when the panel's filter hides it
+static int view_insert(PanelProp *panel, int node_index) {
+    FileList *list = panel->files;
+    if (!panel_filter_shows(panel, &list->nodes[node_index])) return -1;
+    panel_view_reserve(panel, list->count);
+
+    int index = sorted_position(list, panel->order, panel->files_count, node_index, panel->sort_order, 0);
+    memmove(&panel->order[index + 1], &panel->order[index], (panel->files_count - index) * sizeof(int));
+    panel->order[index] = node_index;
+    panel->files_count++;
+    return index;
+}
+
+
+// Take entry 'node_index' out of the view, unselecting it. Returns 1 if it was selected.
+static int view_remove(PanelProp *panel, int node_index) {
+    for (int index = 0; index < panel->files_count; index++) {
+        if (panel->order[index] != node_index) continue;
+
+        int was_selected = panel_is_selected(panel, index);
+        panel_select(panel, index, 0);
+        memmove(&panel->order[index], &panel->order[index + 1], (panel->files_count - index - 1) * sizeof(int));
+        panel->files_count--;
+        return was_selected;
+    }
+    return 0;
+}
+
+
+// Append an entry, its strings must already be in the list's arena.
+// Panels showing the listing get it inserted at its sorted place.
+int file_list_add(FileList *list, FileNode *node) {
+    PanelProp *views[2];
+    int count = file_list_views(list, views);
+
+    for (int i = 0; i < count; i++) {
+        panel_forget_sorted_views(views[i]);
+        panel_forget_search(views[i]);
+    }
+
+    file_list_reserve(list, 1);
+    int node_index = list->count++;
+    list->nodes[node_index] = *node;
+    if (list->collation != NULL) list->collation[node_index] = NULL;
+    if (list->display != NULL) list->display[node_index] = NULL;
+    free(list->name_order);
+    list->name_order = NULL;
+
+    for (int i = 0; i < count; i++) {
+        view_insert(views[i], node_index);
+    }
+    return node_index;
+}
+
+
+// Replace an entry with its new metadata, it moves to its new sorted place and stays selected
+void file_list_update(FileList *list, int node_index, FileNode *node) {
+    PanelProp *views[2];
+    int count = file_list_views(list, views);
+    int was_selected[2];
+
+    for (int i = 0; i < count; i++) {
+        panel_forget_sorted_views(views[i]);
+        panel_damage(views[i]);
+        was_selected[i] = view_remove(views[i], node_index);
+    }
+
+    list->nodes[node_index] = *node;
+
+    for (int i = 0; i < count; i++) {
+        int index = view_insert(views[i], node_index);
+        if (was_selected[i] && index >= 0) panel_select(views[i], index, 1);
+    }
+}
+
+
+// Remove an entry from the listing and from the views of the panels showing it.
+// The last entry moves into the freed slot, so the other entries keep their index.
+void file_list_remove(FileList *list, int node_index) {
+    PanelProp *views[2];
+    int count = file_list_views(list, views);
+    int last = list->count - 1;
+
+    for (int i = 0; i < count; i++) {
+        PanelProp *panel = views[i];
+        panel_forget_sorted_views(panel);
+        panel_forget_search(panel);
+        panel_damage(panel);
+        view_remove(panel, node_index);
+        if (node_index == last) continue;
+
+        for (int index = 0; index < panel->files_count; index++) {
+            if (panel->order[index] == last) panel->order[index] = node_index;
+        }
+        if (panel->selected[last / 8] & (1 << (last % 8))) {
+            panel->selected[node_index / 8] |= 1 << (node_index % 8);
+            panel->selected[last / 8] &= ~(1 << (last % 8));
+        }
+    }
+
+    if (list->index != NULL) {
+        file_list_index(list);
+        file_list_unindex(list, node_index);
+        if (node_index != last) list->index[file_list_slot(list, list->nodes[last].name, last)] = node_index + 1;
+        list->indexed--;
+    }
+
+    list->nodes[node_index] = list->nodes[last];
+    if (list->collation != NULL) list->collation[node_index] = list->collation[last];
+    if (list->display != NULL) list->display[node_index] = list->display[last];
+    free(list->name_order);
+    list->name_order = NULL;
+    list->count--;
+}
+
+
+// Show 'list' in the panel, the panel takes over the caller's reference to it and to 'order',
+// the view sorted by the panel's sort order and filtered by its filter, with 'count' rows and room
+// for all entries. Without 'order' entries show in directory order until sort_panel_files().
+// Selection starts empty, the previous listing is released.
+void panel_set_files(PanelProp *panel, FileList *list, int *order, int count) {
+    panel_forget_sorted_views(panel);
+    panel_forget_search(panel);
+    panel_damage(panel);
+    file_list_release(panel->files);
+    free(panel->order);
+    free(panel->selected);
+
+    panel->files = list;
+    panel->order = order;
+    panel->selected = NULL;
+    panel->view_capacity = 0;
+    panel->files_count = order ? count : list ? list->count : 0;
     panel->num_selected_files = 0;
     panel->bytes_selected_files = 0;
+    panel->incomplete = 0;
 
-    if ((dir = opendir(panel->path)) == NULL) {
-        return 0;
+    if (order != NULL) {
+        panel->selected = calloc((list->count + 7) / 8, 1);
+        panel->view_capacity = list->count;
+        panel->sorted_by = panel->sort_order;
     }
+}
 
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0) continue;
-        if (strcmp(entry->d_name, "..") == 0 && strcmp(panel->path, "/") == 0) continue;
-
-        char full_path[CMD_MAX];
-        snprintf(full_path, sizeof(full_path), "%s/%s", panel->path, entry->d_name);
-        lstat(full_path, &file_stat);
-
-        FileNode *new_node = (FileNode*) calloc(1,sizeof(FileNode));
-
-        panel->files_count++;
-        new_node->next = NULL;
-        new_node->name = strdup(entry->d_name);
-
-        new_node->mtime = file_stat.st_mtime;
-        new_node->size = file_stat.st_size;
-        new_node->chmod = file_stat.st_mode;
-        new_node->chown = file_stat.st_uid;
-        new_node->is_dir = S_ISDIR(file_stat.st_mode);
-        new_node->is_executable = (file_stat.st_mode & S_IXUSR) || (file_stat.st_mode & S_IXGRP) || (file_stat.st_mode & S_IXOTH);
-        new_node->is_link = S_ISLNK(file_stat.st_mode);
-        new_node->is_link_broken = 0;
-        new_node->is_link_to_dir = 0;
-        new_node->is_device = S_ISBLK(file_stat.st_mode) || S_ISCHR(file_stat.st_mode);
-
-        if (new_node->is_link) {
-            new_node->link_target = NULL;
-            char target[CMD_MAX];
-            ssize_t len = readlink(full_path, target, sizeof(target) - 1);
-            if (len != -1) {
-                target[len] = '\0';
-                new_node->link_target = strdup(target);
-            }
 
-            if (stat(full_path, &link_stat) != 0) {
-                new_node->is_link_broken = 1;  // Link is broken
+// Drop the views kept for other sort orders, they are stale once the listing changes
+void panel_forget_sorted_views(PanelProp *panel) {
+    for (int i = 0; i < SORT_VIEWS_KEPT; i++) {
+        free(panel->sorted_views[i].order);
+        panel->sorted_views[i].order = NULL;
+    }
+}
+
+
+// Show the panel's listing in another sort order without reading the directory again. The view
+// being left is kept, so switching back and forth between a few orders needs no sorting at all.
+// The directory is read when the listing lacks what the new order sorts by.
+void panel_change_sort_order(PanelProp *panel, SortOrders sort_order) {
+    panel->sort_order = sort_order;
+    int fields = scan_fields_for_panel(panel);
+    if (panel->files == NULL || panel->order == NULL || panel->loading || (panel->files->fields & fields) != fields) {
+        update_panel_files(panel);
+        return;
+    }
+    if (panel->sorted_by == sort_order) return;
+
+    // the view being left takes the slot of the one being shown, or of the order it had itself
+    SortOrders left_by = panel->sorted_by;
+    int *left = malloc(panel->files_count * sizeof(int) + 1);
+    memcpy(left, panel->order, panel->files_count * sizeof(int));
+    SortedView *slot = NULL;
+
+    for (int i = 0; i < SORT_VIEWS_KEPT; i++) {
+        if (panel->sorted_views[i].order != NULL && panel->sorted_views[i].sort_order == sort_order) slot = &panel->sorted_views[i];
+    }
+
+    if (slot != NULL) {
+        memcpy(panel->order, slot->order, panel->files_count * sizeof(int));
+        panel->sorted_by = sort_order;
+    } else {
+        sort_panel_files(panel);
+        for (int i = 0; i < SORT_VIEWS_KEPT && slot == NULL; i++) {
+            if (panel->sorted_views[i].order != NULL && panel->sorted_views[i].sort_order == left_by) slot = &panel->sorted_views[i];
+        }
+        if (slot == NULL) {
+            slot = &panel->sorted_views[panel->sorted_views_next];
+            panel->sorted_views_next = (panel->sorted_views_next + 1) % SORT_VIEWS_KEPT;
+        }
+    }
+
+    free(slot->order);
+    slot->order = left;
+    slot->sort_order = left_by;
+}
+
+
+FileNode *panel_file(PanelProp *panel, int index) {
+    if (panel->files == NULL || index < 0 || index >= panel->files_count) return NULL;
+    return &panel->files->nodes[panel->order ? panel->order[index] : index];
+}
+
+
+// Map every entry of the listing to the row showing it
+static void panel_index_rows(PanelProp *panel) {
+    int count = panel->files->count;
+    if (count > panel->rows_capacity) {
+        panel->rows_capacity = panel->files->capacity > count ? panel->files->capacity : count;
+        panel->rows = realloc(panel->rows, panel->rows_capacity * sizeof(int));
+    }
+
+    memset(panel->rows, -1, count * sizeof(int));
+    for (int index = 0; index < panel->files_count; index++) {
+        panel->rows[panel->order[index]] = index;
+    }
+}
+
+
+// Row of the panel showing the entry called 'name', -1 if there is none
+int panel_find_file(PanelProp *panel, const char *name) {
+    if (panel->files == NULL) return -1;
+
+    int node_index = file_list_find(panel->files, name);
+    if (node_index < 0) return -1;
+    return panel_row_of(panel, node_index);
+}
+
+
+// Row of the panel showing entry 'node_index', -1 if it is not in the view. The panel's row index
+// is not kept up to date while the view changes: a row is trusted when it really shows the entry,
+// otherwise the row index is rebuilt, once per change of the view.
+int panel_row_of(PanelProp *panel, int node_index) {
+    if (panel->order == NULL) return node_index < panel->files_count ? node_index : -1;
+    if (panel->filter != NULL && !panel_filter_shows(panel, &panel->files->nodes[node_index])) return -1;
+
+    int row = node_index < panel->rows_capacity ? panel->rows[node_index] : -1;
+    if (row < 0 || row >= panel->files_count || panel->order[row] != node_index) {
+        panel_index_rows(panel);
+        row = panel->rows[node_index];
+    }
+    return row;
+}
+
+
+int panel_is_selected(PanelProp *panel, int index) {
+    FileNode *node = panel_file(panel, index);
+    if (node == NULL || panel->selected == NULL) return 0;
+
+    int node_index = node - panel->files->nodes;
+    return (panel->selected[node_index / 8] >> (node_index % 8)) & 1;
+}
+
+
+// Select or unselect entry 'node_index', keeping the panel's selection totals
+static void panel_select_node(PanelProp *panel, int node_index, int selected) {
+    FileNode *node = &panel->files->nodes[node_index];
+    int mask = 1 << (node_index % 8);
+    if (panel->selected == NULL || !(panel->selected[node_index / 8] & mask) == !selected) return;
+
+    panel->selected[node_index / 8] ^= mask;
+    panel->num_selected_files += selected ? 1 : -1;
+    if (!node->is_dir) panel->bytes_selected_files += selected ? node->size : -node->size;
+}
+
+
+// Select or unselect the entry on row 'index'
+void panel_select(PanelProp *panel, int index, int selected) {
+    if (selected) resolve_panel_files(panel, index, 1, SCAN_NEED_DISPLAY);  // counts with its size
+    FileNode *node = panel_file(panel, index);
+    if (node != NULL) panel_select_node(panel, node - panel->files->nodes, selected);
+}
+
+
+// Build the panel's view again after its filter changed. A stricter filter only drops rows from
+// the view, any other is applied to all entries by sorting them again. Entries which get hidden
+// are unselected, the cursor stays on its entry as long as that is shown.
+void panel_filter_view(PanelProp *panel, int narrowing) {
+    panel_forget_sorted_views(panel);
+    if (panel->files == NULL || panel->order == NULL || panel->loading) return;  // filtered when sorted
+
+    FileList *list = panel->files;
+    FileNode *cursor = panel_file(panel, panel->selected_index);
+
+    if (narrowing) {
+        int rows = 0;
+        for (int index = 0; index < panel->files_count; index++) {
+            int node_index = panel->order[index];
+            if (panel_filter_shows(panel, &list->nodes[node_index])) {
+                panel->order[rows++] = node_index;
             } else {
-                new_node->is_link_to_dir = S_ISDIR(link_stat.st_mode);
+                panel_select_node(panel, node_index, 0);
             }
         }
+        panel->files_count = rows;
+    } else {
+        sort_panel_files(panel);
+        for (int i = 0; i < list->count && panel->num_selected_files > 0; i++) {
+            if (!panel_filter_shows(panel, &list->nodes[i])) panel_select_node(panel, i, 0);
+        }
+    }
 
-        if (new_node->is_link_to_dir) new_node->is_dir = 1;
+    int row = cursor != NULL ? panel_row_of(panel, cursor - list->nodes) : -1;
+    if (row >= 0) panel->selected_index = row;
+}
 
-        // Check if this file was selected in the original list
-        FileNode *old_node = original_head;
-        while (old_node != NULL) {
-            if (old_node->is_selected && strcmp(new_node->name, old_node->name) == 0) {
-                new_node->is_selected = true;
-                panel->num_selected_files++;
-                if (!new_node->is_dir) panel->bytes_selected_files+=new_node->size;
-                break;
-            }
-            old_node = old_node->next;
+
+// Select the entries which were selected in the panel's previous listing,
+// in time linear in the number of entries
+static void panel_restore_selection(PanelProp *panel, FileList *original, unsigned char *original_selected) {
+    if (original == NULL || original_selected == NULL) return;
+
+    FileList *list = panel->files;
+    int dir_fd = -1;
+
+    for (int i = 0; i < original->count; i++) {
+        if (!(original_selected[i / 8] & (1 << (i % 8)))) continue;
+
+        int node_index = file_list_find(list, original->nodes[i].name);
+        if (node_index < 0 || !panel_filter_shows(panel, &list->nodes[node_index])) continue;
+
+        // selected files count with their size, which the scan may have skipped
+        FileNode *node = &list->nodes[node_index];
+        if ((node->resolved & SCAN_NEED_DISPLAY) != SCAN_NEED_DISPLAY) {
+            if (dir_fd == -1) dir_fd = open(panel->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dir_fd != -1) scan_entry(dir_fd, node->name, DT_UNKNOWN, SCAN_NEED_DISPLAY, list, node);
+        }
+        panel_select_node(panel, node_index, 1);
+    }
+
+    if (dir_fd != -1) close(dir_fd);
+}
+
+
+// Size of the buffer handed to getdents64(), big enough for a few thousand entries per syscall
+#define SCAN_BUFFER_SIZE (256 * 1024)
+
+// Attributes a directory scan resolves for every entry: only what sorting needs.
+// The rest of what a row shows is resolved by resolve_panel_files() once the row is on screen.
+int scan_fields_for_panel(PanelProp *panel) {
+    int fields = SCAN_NEED_TYPE;
+
+    switch (sort_kind(panel->sort_order)) {
+        case SORT_SIZE:
+            fields |= SCAN_NEED_SIZE;
+            break;
+        case SORT_TIME:
+            fields |= SCAN_NEED_MTIME;
+            break;
+        default:
+            break;
+    }
+
+    // links to directories are sorted among the directories
+    if (sort_dirs_first(panel->sort_order)) fields |= SCAN_NEED_LINK_TYPE;
+
+    return fields;
+}
+
+
+static unsigned int scan_statx_mask(int fields) {
+    unsigned int mask = 0;
+    if (fields & SCAN_NEED_TYPE) mask |= STATX_TYPE;
+    if (fields & SCAN_NEED_MODE) mask |= STATX_MODE;
+    if (fields & SCAN_NEED_SIZE) mask |= STATX_SIZE;
+    if (fields & SCAN_NEED_MTIME) mask |= STATX_MTIME;
+    return mask;
+}
+
+
+// link targets go to the listing's arena, which is shared by the stat pool threads
+static pthread_mutex_t link_target_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Fill node metadata for entry 'name' relative to the open directory 'dir_fd'.
+// When only the file type is needed and the filesystem reports d_type, no stat call is made at all.
+// Returns -1 if the entry does not exist (anymore).
+int scan_entry(int dir_fd, const char *name, unsigned char d_type, int fields, FileList *list, FileNode *node) {
+    mode_t mode = 0;
+    int ret = 0;
+
+    if ((fields & ~(SCAN_NEED_TYPE | SCAN_NEED_LINK | SCAN_NEED_LINK_TYPE)) == 0 && d_type != DT_UNKNOWN) {
+        mode = DTTOIF(d_type);
+    } else {
+        struct statx stx;
+        if (statx(dir_fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, scan_statx_mask(fields), &stx) == 0) {
+            mode = stx.stx_mode;
+            node->mtime = stx.stx_mtime.tv_sec;
+            node->size = stx.stx_size;
+            node->chown = stx.stx_uid;
+        } else if (errno == ENOENT) {
+            ret = -1;
+        } else if (d_type != DT_UNKNOWN) {
+            mode = DTTOIF(d_type);
         }
+    }
+
+    node->chmod = mode;
+    node->is_dir = S_ISDIR(mode);
+    node->is_executable = (mode & S_IXUSR) || (mode & S_IXGRP) || (mode & S_IXOTH);
+    node->is_link = S_ISLNK(mode);
+    node->is_link_broken = 0;
+    node->is_link_to_dir = 0;
+    node->is_device = S_ISBLK(mode) || S_ISCHR(mode);
+    node->link_target = NULL;
+
+    if (node->is_link && (fields & SCAN_NEED_LINK)) {
+        char target[CMD_MAX];
+        ssize_t len = readlinkat(dir_fd, name, target, sizeof(target) - 1);
+        if (len != -1) {
+            target[len] = '\0';
+            pthread_mutex_lock(&link_target_lock);
+            node->link_target = file_list_strdup(list, target);
+            pthread_mutex_unlock(&link_target_lock);
+        }
+    }
 
-        if (head == NULL) {
-            head = new_node;
-            current = head;
+    if (node->is_link && (fields & (SCAN_NEED_LINK | SCAN_NEED_LINK_TYPE))) {
+        struct statx link_stx;
+        if (statx(dir_fd, name, AT_NO_AUTOMOUNT, STATX_TYPE, &link_stx) != 0) {
+            node->is_link_broken = 1;  // Link is broken
         } else {
-            current->next = new_node;
-            current = new_node;
+            node->is_link_to_dir = S_ISDIR(link_stx.stx_mode);
+        }
+    }
+
+    if (node->is_link_to_dir) node->is_dir = 1;
+    node->color = file_color_class(name, mode, node->is_dir);
+    node->resolved = fields;
+    return ret;
+}
+
+
+// Resolve 'fields' for entries [first, first + count) which the directory scan left out,
+// called for the rows about to be drawn. Every entry is resolved once, the result stays in its node.
+void resolve_panel_files(PanelProp *panel, int first, int count, int fields) {
+    int dir_fd = -1;
+
+    for (int index = first; index < first + count; index++) {
+        FileNode *node = panel_file(panel, index);
+        if (node == NULL) break;
+        if ((node->resolved & fields) == fields) continue;
+
+        if (dir_fd == -1) {
+            dir_fd = open(panel->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dir_fd == -1) return;
         }
+        scan_entry(dir_fd, node->name, DT_UNKNOWN, fields | node->resolved, panel->files, node);
     }
 
-    closedir(dir);
-    panel->files = head;
+    if (dir_fd != -1) close(dir_fd);
+}
+
+
+typedef struct SortContext {
+    FileList *list;
+    SortOrders sort_order;
+} SortContext;
+
+
+static int compare_entries_qsort(const void *a, const void *b, void *arg) {
+    SortContext *context = arg;
+    return compare_entries(context->list, *(const int *) a, *(const int *) b, context->sort_order);
+}
 
-    free_file_nodes(original_head);
 
-    return panel->files_count;
+static int sort_attributes_equal(FileNode *a, FileNode *b, SortKinds kind) {
+    if (a->is_dir != b->is_dir) return 0;
+    if (kind == SORT_SIZE) return a->size == b->size;
+    if (kind == SORT_TIME) return a->mtime == b->mtime;
+    return 1;  // name sorts, and the entries were matched by name
 }
 
-void free_file_nodes(FileNode *head) {
-    FileNode *tmp;
-    while (head != NULL) {
-        free(head->name);
-        free(head->link_target);
-        tmp = head;
-        head = head->next;
-        free(tmp);
+
+// Index in 'list' of every entry of 'original', -1 for entries which are gone. Both were read from
+// the same directory, which returns entries in the same order as long as they stay, so names are
+// compared side by side and only looked up when they differ.
+static int *file_list_match(FileList *original, FileList *list) {
+    int *match = malloc((original->count + 1) * sizeof(int));
+    int next = 0;
+
+    for (int i = 0; i < original->count; i++) {
+        const char *name = original->nodes[i].name;
+        if (next < list->count && strcmp(list->nodes[next].name, name) == 0) {
+            match[i] = next++;
+        } else {
+            match[i] = file_list_find(list, name);
+            if (match[i] >= 0) next = match[i] + 1;
+        }
     }
+    return match;
+}
+
+
+// Sort the re-read listing of a directory by patching the panel's previous view of it, so a
+// refresh costs about as much as what changed: entries which kept their sort attributes keep
+// their order, added and changed ones are binary searched into it. Returns 0 when too much
+// changed, the caller sorts from scratch then.
+static int sort_panel_incremental(PanelProp *panel, FileList *original, int *original_order, int original_count) {
+    FileList *list = panel->files;
+    SortKinds kind = sort_kind(panel->sort_order);
+    int max_changes = list->count * SORT_INCREMENTAL_PERCENT / 100;
+    int ret = 0;
+
+    unsigned char *kept = calloc(list->count + 1, 1);
+    int *match = file_list_match(original, list);
+    int *retained = malloc((original_count + 1) * sizeof(int));
+    int *inserted = malloc((list->count + 1) * sizeof(int));
+    int retained_count = 0, inserted_count = 0;
+
+    for (int row = 0; row < original_count; row++) {
+        FileNode *node = &original->nodes[original_order[row]];
+        int index = match[original_order[row]];
+        if (index < 0 || !sort_attributes_equal(node, &list->nodes[index], kind)) {
+            if (row + 1 - retained_count > max_changes) goto done;  // removed or changed so far
+            continue;
+        }
+        kept[index] = 1;
+        retained[retained_count++] = index;
+    }
+
+    for (int i = 0; i < list->count; i++) {
+        if (!kept[i] && panel_filter_shows(panel, &list->nodes[i])) inserted[inserted_count++] = i;
+    }
+    if (inserted_count + original_count - retained_count > max_changes) goto done;
+
+    // a full sort keeps equal sizes and times in directory order, which a re-read may have changed
+    if (kind == SORT_SIZE || kind == SORT_TIME) {
+        for (int row = 1; row < retained_count; row++) {
+            if (compare_entries(list, retained[row - 1], retained[row], panel->sort_order) > 0) goto done;
+        }
+    }
+
+    SortContext context = {list, panel->sort_order};
+    qsort_r(inserted, inserted_count, sizeof(int), compare_entries_qsort, &context);
+
+    // both are sorted, merge them with the inserted entries' rows found by binary search
+    panel_view_reserve(panel, list->count);
+    int rows = 0, from = 0;
+    for (int i = 0; i < inserted_count; i++) {
+        int position = sorted_position(list, retained, retained_count, inserted[i], panel->sort_order, from);
+        memcpy(&panel->order[rows], &retained[from], (position - from) * sizeof(int));
+        rows += position - from;
+        panel->order[rows++] = inserted[i];
+        from = position;
+    }
+    memcpy(&panel->order[rows], &retained[from], (retained_count - from) * sizeof(int));
+
+    panel->files_count = rows + retained_count - from;
+    panel->sorted_by = panel->sort_order;
+    incremental_sorts++;
+    ret = 1;
+
+done:
+    free(kept);
+    free(match);
+    free(retained);
+    free(inserted);
+    return ret;
+}
+
+
+// Read the panel's directory and sort it. When the other panel shows the same directory,
+// unchanged since it was read, its listing is shared instead of reading it again.
+// Returns the number of entries, or -1 if the user cancelled loading.
+int update_panel_files(PanelProp *panel) {
+    PanelProp *other = panel == &left_panel ? &right_panel : &left_panel;
+    int fields = scan_fields_for_panel(panel);
+    int is_root = strcmp(panel->path, "/") == 0;
+
+    // the old listing is kept until its selection is carried over, and its view for re-sorting
+    FileList *original = panel->files;
+    unsigned char *original_selected = panel->selected;
+    int *original_order = panel->order && !panel->loading && panel->sorted_by == panel->sort_order ? panel->order : NULL;
+    int original_count = panel->files_count;
+    DirKey original_key = panel->dir_key;
+    if (original_order == NULL) free(panel->order);
+    panel->files = NULL;
+    panel->selected = NULL;
+    panel->order = NULL;
+    panel_set_files(panel, NULL, NULL, 0);
+
+    int dir_fd = open(panel->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1) {
+        panel_set_files(panel, file_list_new(), NULL, 0);
+        free(original_selected);
+        free(original_order);
+        file_list_release(original);
+        return 0;
+    }
+
+    panel_watch(panel);
+    dir_key_read(dir_fd, &panel->dir_key);
+    watch_read_events();
+
+    // a refresh of a panel sharing its listing has to read the directory again
+    if (other->files != NULL && other->files != original && other->order != NULL && !other->loading && !other->incomplete &&
+        !other->watch_rescan && other->watch_pending_count == 0 &&
+        dir_key_equal(&other->dir_key, &panel->dir_key) && (other->files->fields & fields) == fields) {
+        close(dir_fd);
+        if (other->sort_order == panel->sort_order && panel_filter_equal(panel, other->filter, other->filter_by)) {
+            int *order = malloc(other->files->count * sizeof(int) + 1);
+            memcpy(order, other->order, other->files_count * sizeof(int));
+            panel_set_files(panel, file_list_retain(other->files), order, other->files_count);
+        } else {
+            panel_set_files(panel, file_list_retain(other->files), NULL, 0);
+            sort_panel_files(panel);
+        }
+        panel_restore_selection(panel, original, original_selected);
+        free(original_selected);
+        free(original_order);
+        file_list_release(original);
+        return panel->files_count;
+    }
+
+    FileList *list = file_list_new();
+    list->fields = fields;
+    panel_set_files(panel, list, NULL, 0);
+
+    char *buffer = malloc(SCAN_BUFFER_SIZE);
+    ssize_t nread;
+
+    // every dirent64 record takes at least 24 bytes, so this many entries fit into one buffer
+    int batch_max = SCAN_BUFFER_SIZE / 24;
+    ScanBatch batch = {0};
+    batch.dir_fd = dir_fd;
+    batch.fields = fields;
+    batch.list = list;
+    batch.d_types = malloc(batch_max);
+
+    int cancelled = 0;
+    struct timespec last_redraw;
+    clock_gettime(CLOCK_MONOTONIC, &last_redraw);
+
+    while (!cancelled && (nread = getdents64(dir_fd, buffer, SCAN_BUFFER_SIZE)) > 0) {
+        file_list_reserve(list, batch_max);
+        batch.first = list->count;
+        batch.count = 0;
+        for (ssize_t pos = 0; pos < nread; ) {
+            struct dirent64 *entry = (struct dirent64 *)(buffer + pos);
+            pos += entry->d_reclen;
+
+            if (strcmp(entry->d_name, ".") == 0) continue;
+            if (is_root && strcmp(entry->d_name, "..") == 0) continue;
+
+            FileNode *new_node = &list->nodes[list->count++];
+            memset(new_node, 0, sizeof(FileNode));
+            new_node->name = file_list_strdup(list, entry->d_name);
+            batch.d_types[batch.count++] = entry->d_type;
+
+            // entries the filter hides take their type from d_type and are never stat'ed, scan_batch() skips them
+            if (panel->filter != NULL && entry->d_type != DT_UNKNOWN && entry->d_type != DT_DIR && !panel_filter_match(panel, entry->d_name)) {
+                scan_entry(dir_fd, new_node->name, entry->d_type, SCAN_NEED_TYPE, list, new_node);
+            }
+        }
+
+        // stat the whole batch, in parallel when the filesystem is slow
+        scan_batch(&batch);
+        panel->files_count = list->count;
+
+        // big directory, show what we have so far and let the user cancel
+        if (elapsed_us(&last_redraw) >= LOADING_REDRAW_MS * 1000) {
+            panel->loading = panel->files_count;
+            cancelled = show_loading_progress(panel);
+            clock_gettime(CLOCK_MONOTONIC, &last_redraw);
+        }
+    }
+
+    panel->loading = 0;
+    free(batch.d_types);
+    free(buffer);
+    close(dir_fd);
+
+    // a refresh of the same directory only re-sorts what changed
+    int same_directory = original_order != NULL && original_key.dev == panel->dir_key.dev && original_key.ino == panel->dir_key.ino;
+    if (cancelled || !same_directory || !sort_panel_incremental(panel, original, original_order, original_count)) {
+        // what was read before a cancel stays, sorted like any listing so changes apply to it
+        sort_panel_files(panel);
+        panel->incomplete = cancelled;
+    }
+    panel_restore_selection(panel, original, original_selected);
+    free(original_selected);
+    free(original_order);
+    file_list_release(original);
+
+    return cancelled ? -1 : panel->files_count;
 }
 
 void dive_into_directory(FileNode *current) {
+   char previous_path[CMD_MAX];
+   strcpy(previous_path, active_panel->path);
+
    if (strcmp(current->name, "..") == 0) {
        // Store the last directory name before going up
        char * last_slash = strrchr(active_panel->path, '/');
@@ -182,15 +1331,28 @@ void dive_into_directory(FileNode *current) {
        active_panel->file_under_cursor[0] = '\0';
    }
 
-   free_file_nodes(active_panel->files);
-   active_panel->files = NULL;
-   active_panel->num_selected_files = 0;
-   active_panel->bytes_selected_files = 0;
-   active_panel->files_count = 0;
+   // keep the listing around for when we come back
+   dir_cache_store(active_panel);
+   active_panel->selected_index = 0;
+   active_panel->scroll_index = 0;
+
+   // Update the file list for the new directory, unless we have it cached
+   if (dir_cache_restore(active_panel)) {
+       update_panel_cursor();
+       return;
+   }
 
-   // Update the file list for the new directory
-   update_panel_files(active_panel);
-   sort_file_nodes(&active_panel->files, active_panel->sort_order);
+   if (update_panel_files(active_panel) < 0) {
+       // loading was cancelled, return to where we came from with the cursor on the directory
+       char *entered = active_panel->path + strlen(previous_path);
+       if (*entered == '/') entered++;
+       snprintf(active_panel->file_under_cursor, CMD_MAX, "%s", strlen(active_panel->path) > strlen(previous_path) ? entered : "..");
+       strcpy(active_panel->path, previous_path);
+       if (dir_cache_restore(active_panel)) {
+           update_panel_cursor();
+           return;
+       }
+       update_panel_files(active_panel);
+   }
    update_panel_cursor();
 }
-
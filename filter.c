@@ -0,0 +1,82 @@
+#include "includes.h"
+#include "types.h"
+#include "globals.h"
+
+// Panel filter (Alt+f) hides entries whose names do not match a glob pattern or a regular expression.
+// Only the panel's view is filtered, the listing keeps all entries and can still be shared and cached.
+// Both kinds match anywhere in a name, so typing more of a pattern only ever hides more entries and
+// the view is narrowed instead of built again. Directories and ".." always stay, the user can move on.
+
+
+// Stop filtering, all entries match
+static void panel_filter_free(PanelProp *panel) {
+    if (panel->filter != NULL && panel->filter_by == FILTER_REGEX) regfree(&panel->filter_regex);
+    free(panel->filter);
+    free(panel->filter_glob);
+    panel->filter = NULL;
+    panel->filter_glob = NULL;
+}
+
+
+// The name matches the panel's filter, or the panel has none
+int panel_filter_match(PanelProp *panel, const char *name) {
+    if (panel->filter == NULL) return 1;
+    if (panel->filter_by == FILTER_REGEX) return regexec(&panel->filter_regex, name, 0, NULL, 0) == 0;
+    if (panel->filter_glob == NULL) return strstr(name, panel->filter) != NULL;  // no wildcards
+    return fnmatch(panel->filter_glob, name, 0) == 0;
+}
+
+
+// The entry belongs to the panel's view
+int panel_filter_shows(PanelProp *panel, FileNode *node) {
+    if (node->is_dir && !node->is_link) return 1;
+    return strcmp(node->name, "..") == 0 || panel_filter_match(panel, node->name);
+}
+
+
+// The panel filters with 'filter' of kind 'filter_by', NULL for no filter
+int panel_filter_equal(PanelProp *panel, const char *filter, FilterKinds filter_by) {
+    if (panel->filter == NULL || filter == NULL) return panel->filter == filter;
+    return panel->filter_by == filter_by && strcmp(panel->filter, filter) == 0;
+}
+
+
+// Names matching 'text' all match the panel's filter too, 'text' being the filter with characters
+// appended which make a match stricter: for globs anything but brackets and escapes, for regular
+// expressions anything but alternatives, repetitions which may match nothing, and escapes.
+static int panel_filter_narrows(PanelProp *panel, const char *text, FilterKinds kind) {
+    if (panel->filter == NULL || panel->filter_by != kind) return 0;
+
+    size_t len = strlen(panel->filter);
+    if (len == 0 || panel->filter[len - 1] == '\\' || strncmp(text, panel->filter, len) != 0) return 0;
+    return strpbrk(text + len, kind == FILTER_REGEX ? "|*?{}\\" : "[]\\") == NULL;
+}
+
+
+// Filter the panel's view with 'text' of kind 'kind', an empty text shows all entries again.
+// Returns -1 if 'text' is no valid regular expression, the filter in effect stays then.
+int panel_set_filter(PanelProp *panel, const char *text, FilterKinds kind) {
+    regex_t regex;
+    if (text[0] != '\0' && kind == FILTER_REGEX && regcomp(&regex, text, REG_EXTENDED | REG_NOSUB) != 0) return -1;
+
+    if (panel_filter_equal(panel, text[0] ? text : NULL, kind)) {
+        if (text[0] != '\0' && kind == FILTER_REGEX) regfree(&regex);
+        return 0;
+    }
+
+    int narrowing = text[0] != '\0' && panel_filter_narrows(panel, text, kind);
+    panel_filter_free(panel);
+    if (text[0] != '\0') {
+        panel->filter = strdup(text);
+        panel->filter_by = kind;
+        if (kind == FILTER_REGEX) {
+            panel->filter_regex = regex;
+        } else if (strpbrk(text, "*?[\\") != NULL) {
+            panel->filter_glob = malloc(strlen(text) + 3);
+            sprintf(panel->filter_glob, "*%s*", text);
+        }
+    }
+
+    panel_filter_view(panel, narrowing);
+    return 0;
+}
@@ -5,16 +5,84 @@ void initialize_ncurses(void);
 void draw_buttons(int maxY, int maxX);
 void draw_windows(int maxY, int maxX);
 void shorten(char *name, int width, char *result);
+EntryDisplay *file_list_display(FileList *list, int node_index, int name_width, int current_year);
 void update_panel(WINDOW *win, PanelProp *panel);
+void panel_damage(PanelProp *panel);
 void update_panel_cursor(void);
+WINDOW *panel_window(PanelProp *panel);
+int show_loading_progress(PanelProp *panel);
 void init_screen(void);
 void cleanup(void);
 void redraw_ui(void);
-int compare_nodes(FileNode *a, FileNode *b, SortOrders sort_order);
-void sort_file_nodes(FileNode **head_ref, SortOrders sort_order);
+SortKinds sort_kind(SortOrders sort_order);
+int sort_descending(SortOrders sort_order);
+int sort_dirs_first(SortOrders sort_order);
+int compare_nodes(FileList *list, int a, int b, SortOrders sort_order);
+void sort_panel_files(PanelProp *panel);
+const char *collate_key(SortKinds kind, const char *name, char *key, size_t size);
+void file_list_collate(FileList *list, SortKinds kind);
+int file_color_class(const char *name, mode_t mode, int is_dir);
+int file_color_attrs(int color);
+const char *file_list_collation(FileList *list, int node_index, SortKinds kind, char *key, size_t size);
+void arena_free(ArenaBlock *block);
+char *arena_alloc(ArenaBlock **arena, size_t len);
+FileList *file_list_new(void);
+FileList *file_list_retain(FileList *list);
+void file_list_release(FileList *list);
+char *file_list_strdup(FileList *list, const char *str);
+void file_list_reserve(FileList *list, int more);
+int file_list_find(FileList *list, const char *name);
+int file_list_add(FileList *list, FileNode *node);
+void file_list_update(FileList *list, int node_index, FileNode *node);
+void file_list_remove(FileList *list, int node_index);
+void panel_set_files(PanelProp *panel, FileList *list, int *order, int count);
+void panel_forget_sorted_views(PanelProp *panel);
+void panel_change_sort_order(PanelProp *panel, SortOrders sort_order);
+FileNode *panel_file(PanelProp *panel, int index);
+int panel_find_file(PanelProp *panel, const char *name);
+int panel_row_of(PanelProp *panel, int node_index);
+int *file_list_name_order(FileList *list);
+int panel_quick_search(PanelProp *panel, int skip_current);
+void panel_forget_search(PanelProp *panel);
+int panel_filter_match(PanelProp *panel, const char *name);
+int panel_filter_shows(PanelProp *panel, FileNode *node);
+int panel_filter_equal(PanelProp *panel, const char *filter, FilterKinds filter_by);
+int panel_set_filter(PanelProp *panel, const char *text, FilterKinds kind);
+void panel_filter_view(PanelProp *panel, int narrowing);
+int panel_is_selected(PanelProp *panel, int index);
+void panel_select(PanelProp *panel, int index, int selected);
+int scan_fields_for_panel(PanelProp *panel);
+int scan_entry(int dir_fd, const char *name, unsigned char d_type, int fields, FileList *list, FileNode *node);
+void resolve_panel_files(PanelProp *panel, int first, int count, int fields);
+void scan_batch(ScanBatch *batch);
 int update_panel_files(PanelProp *panel);
 void update_files_in_both_panels(void);
-void free_file_nodes(FileNode *head);
+void refresh_files_in_both_panels(void);
+void panel_watch(PanelProp *panel);
+int watch_read_events(void);
+int watch_pending(void);
+int watch_settle_timeout(void);
+void watch_apply(PanelProp *panel);
+void watch_apply_both_panels(void);
+int wait_for_key(void);
+int event_wait_key(void (*draw)(void));
+int event_add(int fd, EventHandler handler, void *arg);
+void event_remove(int fd);
+int event_timer_new(EventHandler handler, void *arg);
+void event_timer_set(int fd, int ms);
+void event_consume(int fd);
+void event_request_frame(void);
+int job_start(const char *command, const char *path);
+int jobs_count(void);
+void jobs_status(char *status, size_t size);
+void jobs_view(void);
+void watch_release(int wd);
+int dir_key_read(int dir_fd, DirKey *key);
+int dir_key_equal(DirKey *a, DirKey *b);
+int dir_cache_uses_watch(int wd);
+void dir_cache_invalidate_watch(int wd);
+void dir_cache_store(PanelProp *panel);
+int dir_cache_restore(PanelProp *panel);
 int lines(char * title);
 WINDOW *create_dialog(char *title, char *buttons[], int prompt_is_present, int is_danger, int vertical_buttons);
 void update_dialog_buttons(WINDOW *win, char * title, char *buttons[], int selected, int prompt_present, int editing_prompt, int is_danger, int vertical_buttons);
@@ -25,7 +93,6 @@ void update_cmd(void);
 void display_line(WINDOW *win, file_lines *line, int max_x, int current_col, int editor_mode, PatternColorPair* patterns, int num_patterns);
 int view_file(char *filename);
 int edit_file(char *filename);
-int file_has_extension(const char *filename, const char *extensions[]);
 void dive_into_directory(FileNode *current);
 int noesc(int ch);
 void format_size_with_units(off_t size, char *size_str, size_t len, int maxlen);
@@ -36,6 +103,7 @@ void create_progress_dialog(int title_lines);
 int file_exists(const char *path);
 int update_progress_dialog(char *title, int current_progress, int total_progress, char *infotext);
 int update_progress_dialog_delta(char *title, int current_progress, int total_progress, char *infotext);
+long elapsed_us(struct timespec *start);
 int panel_mass_action(OperationFunc func, char *tgt, operationContext *context);
 int recursive_operation(const char *src, const char *tgt, operationContext *context, OperationFunc func);
 int copy_operation(const char *src, const char *tgt, operationContext *context);
@@ -78,6 +78,8 @@ void redraw_ui() {
 
    draw_windows(maxY, maxX);
    draw_buttons(maxY, maxX);
+   update_panel(win1, &left_panel);
+   update_panel(win2, &right_panel);
    update_cmd();
-   refresh();
+   doupdate();
 }
@@ -0,0 +1,402 @@
+#include "includes.h"
+#include "types.h"
+#include "globals.h"
+
+// Commands ending with '&' run as background jobs on a pseudo terminal while the panels stay usable.
+// The main loop reads their output into a buffer of lines as it comes and learns about their exit
+// from a pidfd, or by polling from a timer where there are none, the panels are refreshed then.
+// Ctrl+O shows the output, the command line shows how many jobs are running. At most JOBS_KEPT
+// jobs are kept, finished ones make room for new ones, running ones are never dropped.
+
+typedef struct Job {
+    pid_t pid;
+    char *command;
+    char path[CMD_MAX];
+    int pty;         // master side, open until the command exited, closing it hangs the terminal up
+    int pidfd;       // readable when the command exited, -1 if not watched
+    int exit_timer;  // without a pidfd, polls for the exit once the output ended, else -1
+    int running;
+    int status;      // wait status once it exited
+    int seen;        // output was looked at after it exited
+    char **lines;    // ring of output lines, the oldest at 'first'
+    int first;
+    int count;
+    char *partial;   // line being written, not ended by a newline yet
+    size_t partial_len;
+    size_t partial_size;
+    int carriage;    // a carriage return came, the next character starts the line again
+    int escape;      // state of a terminal escape sequence being skipped, 0 outside of one
+} Job;
+
+static Job *jobs[JOBS_KEPT];
+static int job_count = 0;
+
+static int jobs_view_index;   // job shown by jobs_view()
+static int jobs_view_scroll;  // lines scrolled up from the end of its output
+static WINDOW *jobs_top_win;
+static WINDOW *jobs_content_win;
+
+
+static void job_free(Job *job) {
+    if (job->pty != -1) {
+        event_remove(job->pty);
+        close(job->pty);
+    }
+    if (job->pidfd != -1) {
+        event_remove(job->pidfd);
+        close(job->pidfd);
+    }
+    if (job->exit_timer != -1) {
+        event_remove(job->exit_timer);
+        close(job->exit_timer);
+    }
+    for (int i = 0; i < job->count; i++) free(job->lines[(job->first + i) % JOB_OUTPUT_LINES]);
+    free(job->lines);
+    free(job->partial);
+    free(job->command);
+    free(job);
+}
+
+
+static void job_end_line(Job *job) {
+    char *line = malloc(job->partial_len + 1);
+    memcpy(line, job->partial, job->partial_len);
+    line[job->partial_len] = '\0';
+    job->partial_len = 0;
+
+    if (job->count == JOB_OUTPUT_LINES) {  // the oldest line makes room
+        free(job->lines[job->first]);
+        job->first = (job->first + 1) % JOB_OUTPUT_LINES;
+        job->count--;
+    }
+    job->lines[(job->first + job->count) % JOB_OUTPUT_LINES] = line;
+    job->count++;
+}
+
+
+static void job_put_char(Job *job, char ch) {
+    if (job->carriage) {
+        job->partial_len = 0;  // progress bars redraw their line
+        job->carriage = 0;
+    }
+    if (job->partial_len + 1 >= job->partial_size) {
+        job->partial_size = job->partial_size ? job->partial_size * 2 : 256;
+        job->partial = realloc(job->partial, job->partial_size);
+    }
+    job->partial[job->partial_len++] = ch;
+}
+
+
+// Add output of the job to its lines. The terminal is a dumb one, escape sequences programs
+// send anyway are dropped, carriage returns and backspaces overwrite what was written.
+static void job_add_output(Job *job, const char *data, ssize_t len) {
+    for (ssize_t i = 0; i < len; i++) {
+        unsigned char ch = data[i];
+
+        if (job->escape == 1) {  // after ESC: CSI, OSC or a two byte sequence
+            job->escape = ch == '[' ? 2 : ch == ']' ? 3 : 0;
+            continue;
+        }
+        if (job->escape == 2) {  // CSI ends with a byte from '@' to '~'
+            if (ch >= '@' && ch <= '~') job->escape = 0;
+            continue;
+        }
+        if (job->escape == 3) {  // OSC ends with BEL or ESC '\'
+            if (ch == '\a') job->escape = 0;
+            if (ch == 27) job->escape = 1;
+            continue;
+        }
+
+        if (ch == 27) {
+            job->escape = 1;
+        } else if (ch == '\n') {
+            job->carriage = 0;
+            job_end_line(job);
+        } else if (ch == '\r') {
+            job->carriage = 1;
+        } else if (ch == '\b') {
+            if (job->partial_len > 0) job->partial_len--;
+        } else if (ch == '\t') {
+            do job_put_char(job, ' '); while (job->partial_len % 8 != 0);
+        } else if (ch >= ' ') {
+            job_put_char(job, ch);
+        }
+    }
+}
+
+
+// The command exited, show what it changed. Panels without a watch would not notice.
+static void job_exited(Job *job, int status) {
+    job->running = 0;
+    job->status = status;
+
+    // what the command wrote last may still wait in the terminal
+    char buffer[65536];
+    ssize_t len;
+    while ((len = read(job->pty, buffer, sizeof(buffer))) > 0) job_add_output(job, buffer, len);
+    if (job->partial_len > 0) job_end_line(job);
+    event_remove(job->pty);
+    close(job->pty);
+    job->pty = -1;
+
+    watch_read_events();
+    if (left_panel.watch_wd == 0) left_panel.watch_rescan = 1;
+    if (right_panel.watch_wd == 0) right_panel.watch_rescan = 1;
+    watch_apply_both_panels();
+    event_request_frame();
+}
+
+
+static void job_on_exit(int fd, void *arg) {
+    Job *job = arg;
+    int status = 0;
+    if (waitpid(job->pid, &status, WNOHANG) == 0) return;
+
+    event_remove(fd);
+    close(fd);
+    job->pidfd = -1;
+    job_exited(job, status);
+}
+
+
+// Without a pidfd the exit is polled for, the command may well outlive its terminal
+static void job_on_exit_timer(int fd, void *arg) {
+    Job *job = arg;
+    int status = 0;
+    event_consume(fd);
+    if (waitpid(job->pid, &status, WNOHANG) != job->pid) {
+        event_timer_set(fd, JOB_EXIT_POLL_MS);
+        return;
+    }
+
+    event_remove(fd);
+    close(fd);
+    job->exit_timer = -1;
+    job_exited(job, status);
+}
+
+
+static void job_on_output(int fd, void *arg) {
+    Job *job = arg;
+    char buffer[65536];
+    ssize_t len = read(fd, buffer, sizeof(buffer));
+
+    if (len > 0) {
+        job_add_output(job, buffer, len);
+        event_request_frame();
+        return;
+    }
+    if (len == -1 && (errno == EAGAIN || errno == EINTR)) return;
+
+    // EIO: no process has the terminal open any more, but the command may live on without it.
+    // The terminal stays open until it exited, else it would be hung up. Other errors leave the
+    // output unreadable, neither tells whether the command exited.
+    event_remove(fd);
+
+    if (job->pidfd == -1 && job->exit_timer == -1) {  // no pidfd, look for the exit now and then
+        int status = 0;
+        if (waitpid(job->pid, &status, WNOHANG) == job->pid) {
+            job_exited(job, status);
+        } else {
+            job->exit_timer = event_timer_new(job_on_exit_timer, job);
+            event_timer_set(job->exit_timer, JOB_EXIT_POLL_MS);
+        }
+    }
+}
+
+
+// Run 'command' with /bin/sh in 'path' as a background job. Returns -1 if it could not be started,
+// -2 if JOBS_KEPT jobs are still running.
+int job_start(const char *command, const char *path) {
+    // the oldest job which is done makes room
+    int drop = 0;
+    while (drop < job_count && jobs[drop]->running) drop++;
+    if (job_count == JOBS_KEPT && drop == job_count) return -2;
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master == -1) return -1;
+    char *slave_name = grantpt(master) == 0 && unlockpt(master) == 0 ? ptsname(master) : NULL;
+    if (slave_name == NULL) {
+        close(master);
+        return -1;
+    }
+
+    // programs see a terminal of the screen's size which understands no escape sequences
+    struct winsize size = { .ws_row = LINES - 2, .ws_col = COLS };
+    ioctl(master, TIOCSWINSZ, &size);
+
+    extern char **environ;
+    int env_count = 0;
+    while (environ[env_count]) env_count++;
+    char **env = malloc((env_count + 2) * sizeof(char *));
+    int n = 0;
+    for (int i = 0; i < env_count; i++) {
+        if (strncmp(environ[i], "TERM=", 5) != 0) env[n++] = environ[i];
+    }
+    env[n++] = "TERM=dumb";
+    env[n] = NULL;
+    char slave_path[CMD_MAX];
+    snprintf(slave_path, sizeof(slave_path), "%s", slave_name);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // the child gets the terminal as its controlling one, only async-signal-safe calls from here on
+        setsid();
+        int slave = open(slave_path, O_RDWR);
+        if (slave == -1) _exit(127);
+        ioctl(slave, TIOCSCTTY, 0);
+        dup2(slave, STDIN_FILENO);
+        dup2(slave, STDOUT_FILENO);
+        dup2(slave, STDERR_FILENO);
+        if (slave > STDERR_FILENO) close(slave);
+        if (chdir(path) != 0) _exit(127);
+        execle("/bin/sh", "sh", "-c", command, (char *) NULL, env);
+        _exit(127);
+    }
+    free(env);
+    if (pid == -1) {
+        close(master);
+        return -1;
+    }
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    if (job_count == JOBS_KEPT) {
+        job_free(jobs[drop]);
+        memmove(&jobs[drop], &jobs[drop + 1], (job_count - drop - 1) * sizeof(Job *));
+        job_count--;
+    }
+
+    Job *job = calloc(1, sizeof(Job));
+    job->pid = pid;
+    job->command = strdup(command);
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    job->pty = master;
+    job->exit_timer = -1;
+    job->running = 1;
+    job->lines = malloc(JOB_OUTPUT_LINES * sizeof(char *));
+    job->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    jobs[job_count++] = job;
+
+    event_add(master, job_on_output, job);
+    if (job->pidfd != -1 && event_add(job->pidfd, job_on_exit, job) != 0) {
+        close(job->pidfd);
+        job->pidfd = -1;
+    }
+    event_request_frame();
+    return 0;
+}
+
+
+int jobs_count() {
+    return job_count;
+}
+
+
+// What the command line shows about the jobs, "" when there is nothing to tell
+void jobs_status(char *status, size_t size) {
+    int running = 0;
+    for (int i = 0; i < job_count; i++) running += jobs[i]->running;
+    Job *last = job_count > 0 ? jobs[job_count - 1] : NULL;
+
+    if (running > 0) {
+        snprintf(status, size, "[%d running] ", running);
+    } else if (last != NULL && !last->seen) {
+        int failed = !WIFEXITED(last->status) || WEXITSTATUS(last->status) != 0;
+        snprintf(status, size, "[%s] ", failed ? "job failed" : "job done");
+    } else {
+        status[0] = '\0';
+    }
+}
+
+
+static void jobs_draw() {
+    int max_y, max_x;
+    getmaxyx(stdscr, max_y, max_x);
+    int rows = max_y - 2;
+    Job *job = jobs[jobs_view_index];
+
+    int total = job->count + (job->partial_len > 0 ? 1 : 0);
+    if (jobs_view_scroll > total - rows) jobs_view_scroll = total - rows;
+    if (jobs_view_scroll < 0) jobs_view_scroll = 0;
+    int first = total - rows - jobs_view_scroll;
+    if (first < 0) first = 0;
+
+    char state[64];
+    if (job->running) {
+        snprintf(state, sizeof(state), "running, pid %d", (int) job->pid);
+    } else if (WIFEXITED(job->status)) {
+        snprintf(state, sizeof(state), "exit status %d", WEXITSTATUS(job->status));
+    } else {
+        snprintf(state, sizeof(state), "killed by signal %d", WTERMSIG(job->status));
+    }
+    werase(jobs_top_win);
+    mvwprintw(jobs_top_win, 0, 0, "Job %d/%d: %s", jobs_view_index + 1, job_count, SHORTEN(job->command, max_x - 40));
+    mvwprintw(jobs_top_win, 0, max_x - strlen(state) - 1, "%s", state);
+
+    werase(jobs_content_win);
+    for (int row = 0; row < rows && first + row < total; row++) {
+        int line = first + row;
+        if (line < job->count) {
+            mvwaddnstr(jobs_content_win, row, 0, job->lines[(job->first + line) % JOB_OUTPUT_LINES], max_x);
+        } else {
+            mvwaddnstr(jobs_content_win, row, 0, job->partial, job->partial_len < (size_t) max_x ? (int) job->partial_len : max_x);
+        }
+    }
+
+    // whatever was drawn over the windows meanwhile goes away
+    touchwin(jobs_top_win);
+    touchwin(jobs_content_win);
+    wnoutrefresh(jobs_top_win);
+    wnoutrefresh(jobs_content_win);
+    move(max_y - 1, 0);
+    attron(COLOR_PAIR(COLOR_BLACK_ON_CYAN));
+    printw("%-*s", max_x, SHORTEN("Esc/Ctrl+O back  Left/Right other job  Up/Down/PgUp/PgDn scroll  Ctrl+C interrupt", max_x));
+    attroff(COLOR_PAIR(COLOR_BLACK_ON_CYAN));
+    wnoutrefresh(stdscr);
+}
+
+
+// Show the output of the jobs, starting with the last one. Their output keeps coming in meanwhile.
+void jobs_view() {
+    if (job_count == 0) return;
+
+    int max_y, max_x;
+    getmaxyx(stdscr, max_y, max_x);
+    jobs_top_win = newwin(1, max_x, 0, 0);
+    wbkgd(jobs_top_win, COLOR_PAIR(COLOR_BLACK_ON_CYAN));
+    jobs_content_win = newwin(max_y - 2, max_x, 1, 0);
+    wbkgd(jobs_content_win, COLOR_PAIR(COLOR_WHITE_ON_BLUE));
+    jobs_view_index = job_count - 1;
+    jobs_view_scroll = 0;
+    curs_set(0);
+
+    int ch;
+    while ((ch = event_wait_key(jobs_draw)) != 27 && ch != 15 && ch != KEY_F(10) && ch != 'q') {
+        int page = getmaxy(jobs_content_win);
+        if (ch == KEY_UP) jobs_view_scroll++;
+        if (ch == KEY_DOWN) jobs_view_scroll--;
+        if (ch == KEY_PPAGE) jobs_view_scroll += page;
+        if (ch == KEY_NPAGE) jobs_view_scroll -= page;
+        if (ch == KEY_HOME) jobs_view_scroll = JOB_OUTPUT_LINES;
+        if (ch == KEY_END) jobs_view_scroll = 0;
+        if ((ch == KEY_LEFT || ch == KEY_RIGHT) && job_count > 1) {
+            jobs_view_index = (jobs_view_index + (ch == KEY_LEFT ? job_count - 1 : 1)) % job_count;
+            jobs_view_scroll = 0;
+        }
+        if (ch == 3 && jobs[jobs_view_index]->running) kill(-jobs[jobs_view_index]->pid, SIGINT);
+        if (ch == KEY_RESIZE) break;
+    }
+
+    for (int i = 0; i < job_count; i++) {
+        if (!jobs[i]->running) jobs[i]->seen = 1;
+    }
+    delwin(jobs_top_win);
+    delwin(jobs_content_win);
+    jobs_top_win = jobs_content_win = NULL;
+    curs_set(1);
+    if (ch == KEY_RESIZE) {
+        endwin();
+        init_screen();
+    }
+    redraw_ui();
+}
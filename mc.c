@@ -26,6 +26,7 @@ char cmd[CMD_MAX] = {0};
 int cmd_len = 0;
 
 int color_enabled = 1;
+int frame_rate = FRAME_RATE;  // 0 draws after every key
 
 int noesc(int ch) {
 
@@ -43,6 +44,7 @@ int noesc(int ch) {
         if (ch == 10) return KEY_ALT_ENTER;
         if (ch == 'a') return KEY_ALT_a;
         if (ch == 's') return KEY_ALT_s;
+        if (ch == 'f') return KEY_ALT_f;
 
         while (ch >= '0' && ch <= '9') {  // Read numbers
             num = num * 10 + (ch - '0');
@@ -82,11 +84,48 @@ int noesc(int ch) {
 }
 
 
+// Ask what to sort by, then in which direction and where directories go. Two short dialogs
+// fit on a 24 line terminal, one listing every sort order would not. Returns -1 if cancelled.
+static int choose_sort_order(SortOrders current) {
+    SortKinds kind = sort_kind(current);
+    int by = show_dialog("Sort files and directories by:", (char *[]) {
+        "Name",
+        "Size",
+        "Modify time",
+        "Name with numbers by value",
+        "Name ignoring case",
+        "Name in language order",
+        "Extension", NULL}, kind, NULL, 0, 1);
+    if (by == -1) return -1;
+    by--;
+
+    // the basic kinds come with mixed directories too, see SortOrders
+    char *ascending = by == SORT_SIZE ? "from small to big" : by == SORT_TIME ? "from old to new" : "from a to z";
+    char *descending = by == SORT_SIZE ? "from big to small" : by == SORT_TIME ? "from new to old" : "from z to a";
+    char options[4][64];
+    snprintf(options[0], sizeof(options[0]), "%s, dirs first", ascending);
+    snprintf(options[1], sizeof(options[1]), "%s, dirs first", descending);
+    snprintf(options[2], sizeof(options[2]), "%s, mix dirs", ascending);
+    snprintf(options[3], sizeof(options[3]), "%s, mix dirs", descending);
+
+    int selected = 0;
+    if (by == kind) selected = sort_descending(current) + (sort_dirs_first(current) ? 0 : 2);
+    int order = show_dialog("Sort direction:", (char *[]) {
+        options[0], options[1], by < SORT_NATURAL ? options[2] : NULL, options[3], NULL}, selected, NULL, 0, 1);
+    if (order == -1) return -1;
+
+    int desc = (order - 1) % 2;
+    if (by >= SORT_NATURAL) return SORT_BY_NATURAL_DIRSFIRST_ASC + 2 * (by - SORT_NATURAL) + desc;
+    return by + 3 * desc + (order <= 2 ? 6 : 0);
+}
+
+
 int main(int argc, char *argv[]) {
 
     // Define the long options
     static struct option long_options[] = {
         {"nocolor", no_argument, 0, 'b'},
+        {"fps", required_argument, 0, 'f'},
         {"version", no_argument, 0, 'v'},
         {"help", no_argument, 0, 'h'},
         {0, 0, 0, 0}
@@ -96,14 +135,18 @@ int main(int argc, char *argv[]) {
     int option_index = 0;
 
     // parse commandline arguments
-    while ((opt = getopt_long(argc, argv, "bhv", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "bf:hv", long_options, &option_index)) != -1) {
         switch (opt) {
             case 'b':
                 color_enabled = 0;
                 break;
+            case 'f':
+                frame_rate = atoi(optarg);
+                if (frame_rate < 0) frame_rate = 0;
+                break;
             case 'h':
                 fprintf(stderr, "Mini Commander (c) 2023 Tomas Matejicek + ChatGPT\n", argv[0]);
-                fprintf(stderr, "Usage: %s [-b|--nocolor] [-h|--help]\n", argv[0]);
+                fprintf(stderr, "Usage: %s [-b|--nocolor] [-f|--fps N] [-h|--help]\n", argv[0]);
                 return 1;
                 break;
             case 'v':
@@ -114,6 +157,8 @@ int main(int argc, char *argv[]) {
     }
 
 
+    setlocale(LC_COLLATE, "");  // for sorting by locale, the rest of the program keeps the C locale
+
     getcwd(left_panel.path, sizeof(left_panel.path));
     strcpy(right_panel.path, left_panel.path);
 
@@ -134,26 +179,15 @@ int main(int argc, char *argv[]) {
     redraw_ui(); // initial screen
 
     while (1) {
-        update_cmd();
-
-        // Print file names in left and right windows
-        update_panel(win1, &left_panel);
-        update_panel(win2, &right_panel);
+        // the panels and command line are drawn while waiting, once all typed ahead keys are
+        // handled, and directory changes which come in meanwhile are applied right away
+        int ch = noesc(wait_for_key());
         int visible_items = getmaxy(win1) - 5;
 
-        // get current file under cursor
-        FileNode *current = active_panel->files;
-        int index = 0;
-        while (current != NULL && index < active_panel->selected_index) {
-            current = current->next;
-            index++;
-        }
-
-        memset(active_panel->file_under_cursor, 0, CMD_MAX);
-        strncpy(active_panel->file_under_cursor, current->name, strlen(current->name));
-        chdir(active_panel->path);
-
-        int ch = noesc(getch());
+        // get current file under cursor, its name finds it again when the directory is read again
+        FileNode *current = panel_file(active_panel, active_panel->selected_index);
+        resolve_panel_files(active_panel, active_panel->selected_index, 1, SCAN_NEED_DISPLAY);
+        snprintf(active_panel->file_under_cursor, CMD_MAX, "%s", current->name);
 
         if (ch == 0) { // Ctrl+Space
             // TODO: fix when files are selected
@@ -162,25 +196,16 @@ int main(int argc, char *argv[]) {
             panel_mass_action(countstats_operation, "", &stats);
             if (stats.abort != 1) {
                 current->size = stats.total_size;
+                panel_damage(active_panel);
             }
         }
 
         if (ch == KEY_F(2)) { // F2
-            int sort = show_dialog("Sort files and directories by:", (char *[]) {
-            "Sort by name, from a to z, mix dirs",
-            "Sort by size, from small to big, mix dirs",
-            "Sort by modify time, from old to new, mix dirs",
-            "Sort by name, from z to a, mix dirs",
-            "Sort by size, from big to small, mix dirs",
-            "Sort by modify time, from new to old, mix dirs",
-            "Sort by name, from a to z, dirs first",
-            "Sort by size, from small to big, dirs first",
-            "Sort by modify time, from old to new, dirs first",
-            "Sort by name, from z to a, dirs first",
-            "Sort by size, from big to small, dirs first",
-            "Sort by modify time, from new to old, dirs first", NULL}, active_panel->sort_order, NULL, 0, 1);
-            if (sort != -1) active_panel->sort_order = sort - 1;
-            update_files_in_both_panels();
+            int sort = choose_sort_order(active_panel->sort_order);
+            if (sort != -1) {
+                panel_change_sort_order(active_panel, sort);
+                update_panel_cursor();
+            }
         }
 
         if (ch == KEY_F(3)) { // F3
@@ -206,7 +231,7 @@ int main(int argc, char *argv[]) {
                     sprintf(file, "%s/%s", active_panel->path, active_panel->file_under_cursor);
                     edit_file(file);
                     redraw_ui();
-                    update_files_in_both_panels();
+                    refresh_files_in_both_panels();
                }
            }
         }
@@ -231,7 +256,7 @@ int main(int argc, char *argv[]) {
                     panel_mass_action(copy_operation, prompt, &context);
                 }
             }
-            update_files_in_both_panels();
+            refresh_files_in_both_panels();
         }
 
         if (ch == KEY_F(6)) { // F6
@@ -254,7 +279,7 @@ int main(int argc, char *argv[]) {
                     panel_mass_action(move_operation, prompt, &context);
                 }
             }
-            update_files_in_both_panels();
+            refresh_files_in_both_panels();
         }
 
         if (ch == KEY_F(7)) { // F7
@@ -266,6 +291,7 @@ int main(int argc, char *argv[]) {
             sprintf(title, "Enter directory name to create:");
             int btn = show_dialog(title, (char *[]) {"OK", "Cancel", NULL}, 0, prompt, 0, 0);
             if (btn == 1 && strlen(prompt) > 0) {
+                chdir(active_panel->path);  // relative names are created in the panel's directory
                 int err = mkdir_recursive(prompt, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
                 if (!err) {
                     // Check if prompt is relative (doesn't start with '/')
@@ -285,7 +311,7 @@ int main(int argc, char *argv[]) {
                 } else {
                     show_errormsg(SPRINTF("Operation failed\n%s (%d)", strerror(err), err));
                 }
-                update_files_in_both_panels();
+                refresh_files_in_both_panels();
             }
         }
 
@@ -309,7 +335,7 @@ int main(int argc, char *argv[]) {
                     panel_mass_action(delete_operation, "", &context);
                 }
             }
-            update_files_in_both_panels();
+            refresh_files_in_both_panels();
             redraw_ui();
         }
 
@@ -420,7 +446,19 @@ int main(int argc, char *argv[]) {
         }
 
 
-        if (ch == '\n')
+        int continue_filter_mode = 0;
+
+        if (ch == KEY_ALT_f) {  // type a filter for the panel, starting from the one it has
+            if (!active_panel->filter_mode) {
+                snprintf(active_panel->filter_text, CMD_MAX, "%s", active_panel->filter ? active_panel->filter : "");
+                if (active_panel->filter) active_panel->filter_kind = active_panel->filter_by;
+                active_panel->filter_mode = 1;
+            }
+            continue_filter_mode = 1;
+        }
+
+
+        if (ch == '\n' && !active_panel->filter_mode)  // Enter only ends typing the filter
         {
             if (cmd_len == 0) {
                 if (current) {
@@ -436,13 +474,33 @@ int main(int argc, char *argv[]) {
             if (cmd_len > 0) {
                 if (strcmp(cmd, "exit") == 0) exit(0);
 
+                // a trailing '&' runs the command in the background, its output is shown by Ctrl+O
+                int len = cmd_len;
+                while (len > 0 && isspace((unsigned char) cmd[len - 1])) len--;
+                if (len > 1 && cmd[len - 1] == '&' && cmd[len - 2] != '&' && cmd[len - 2] != '\\') {
+                    cmd[len - 1] = '\0';
+                    int started = job_start(cmd, active_panel->path);
+                    cmd[len - 1] = '&';
+                    if (started == 0) {
+                        memset(cmd, 0, CMD_MAX);
+                        cmd_len = cursor_pos = cmd_offset = 0;
+                        continue;
+                    }
+                    if (started == -2) {  // the command stays, to run once a job finished
+                        show_errormsg(SPRINTF("%d jobs are still running", JOBS_KEPT));
+                        continue;
+                    }
+                    // no terminal for it, run it in the foreground
+                }
+
                 endwin();  // End ncurses mode
                 printf("%s@%s:%s# %s\n", username, unameData.nodename, active_panel->path, cmd);
+                chdir(active_panel->path);
                 system(cmd);  // Execute the command
                 init_screen();
                 memset(cmd, 0, CMD_MAX);
                 cmd_len = cursor_pos = cmd_offset = prompt_length = 0;
-                update_files_in_both_panels();
+                refresh_files_in_both_panels();
             }
         }
 
@@ -452,7 +510,9 @@ int main(int argc, char *argv[]) {
             redraw_ui();
         }
 
-        if (ch == 15) {  // Ctrl+O
+        if (ch == 15 && jobs_count() > 0) {  // Ctrl+O, output of the background jobs
+            jobs_view();
+        } else if (ch == 15) {  // Ctrl+O
             endwin();
             initialize_ncurses();
             raw();
@@ -474,6 +534,9 @@ int main(int argc, char *argv[]) {
                     active_panel->search_text[strlen(active_panel->search_text) - 1] = '\0';
                     memcpy(active_panel->prev_search_text, active_panel->search_text, sizeof(active_panel->search_text));
                 }
+            } else if (active_panel->filter_mode) {
+                continue_filter_mode = 1;
+                if (strlen(active_panel->filter_text) > 0) active_panel->filter_text[strlen(active_panel->filter_text) - 1] = '\0';
             } else if (cursor_pos > 0) {
                 memmove(cmd + cursor_pos - 1, cmd + cursor_pos, cmd_len - cursor_pos);
                 cmd[--cmd_len] = '\0';
@@ -534,9 +597,7 @@ int main(int argc, char *argv[]) {
 
         if (ch == KEY_IC) {  // Insert key
             if (current && strcmp(current->name, "..") != 0) {
-                current->is_selected = !current->is_selected;
-                if (!current->is_dir) active_panel->bytes_selected_files += current->is_selected ? current->size : -1 * current->size;
-                active_panel->num_selected_files += current->is_selected ? 1 : -1;
+                panel_select(active_panel, active_panel->selected_index, !panel_is_selected(active_panel, active_panel->selected_index));
             }
             active_panel->selected_index++;
         }
@@ -550,6 +611,13 @@ int main(int argc, char *argv[]) {
                     active_panel->search_text[strlen(active_panel->search_text)] = ch;
                 }
                 memcpy(active_panel->prev_search_text, active_panel->search_text, sizeof(active_panel->search_text));
+            } else if (active_panel->filter_mode) {
+                continue_filter_mode = 1;
+                size_t len = strlen(active_panel->filter_text);
+                if (len < CMD_MAX - 1) {
+                    active_panel->filter_text[len] = ch;
+                    active_panel->filter_text[len + 1] = '\0';
+                }
             } else if (cmd_len < CMD_MAX - 1) {
                 memmove(cmd + cursor_pos + 1, cmd + cursor_pos, cmd_len - cursor_pos);
                 cmd[cursor_pos] = ch;
@@ -558,6 +626,26 @@ int main(int argc, char *argv[]) {
             }
         }
 
+        if (ch == 20 && active_panel->search_mode == 1) {  // Ctrl+T switches how quick search matches
+            continue_search_mode = 1;
+            active_panel->search_kind = (active_panel->search_kind + 1) % (SEARCH_FUZZY + 1);
+            panel_forget_search(active_panel);
+        }
+
+        if (ch == 20 && active_panel->filter_mode) {  // Ctrl+T switches between glob and regular expression
+            continue_filter_mode = 1;
+            active_panel->filter_kind = active_panel->filter_kind == FILTER_GLOB ? FILTER_REGEX : FILTER_GLOB;
+        }
+
+        if (!continue_filter_mode && active_panel->filter_mode) {
+            active_panel->filter_mode = 0;
+        }
+
+        // every key typed filters the view, an invalid regular expression leaves the last valid one
+        if (active_panel->filter_mode) {
+            panel_set_filter(active_panel, active_panel->filter_text, active_panel->filter_kind);
+        }
+
         if (ch == '\t') {
             if (active_panel == &left_panel) {
                 active_panel = &right_panel;
@@ -567,36 +655,14 @@ int main(int argc, char *argv[]) {
         }
 
 
-        if (!continue_search_mode) {
+        if (!continue_search_mode && active_panel->search_mode) {
             active_panel->search_mode = 0;
+            panel_forget_search(active_panel);
         }
 
 
         if (active_panel->search_mode) {
-            FileNode *files = active_panel->files;
-            int index = 0;
-            int found = -1;
-
-            // search from beginning while we get to current item anyway
-            while (files != NULL && index < active_panel->selected_index) {
-                if (strncmp(active_panel->search_text, files->name, strlen(active_panel->search_text)) == 0) {
-                    if (found == -1) found = index;
-                }
-                index++;
-                files = files->next;
-            }
-
-            if (search_skip_current) { index++; files = files->next; }
-
-            while (files != NULL) {
-                if (strncmp(active_panel->search_text, files->name, strlen(active_panel->search_text)) == 0) {
-                    found = index;
-                    break;
-                }
-                index++;
-                files = files->next;
-            }
-
+            int found = panel_quick_search(active_panel, search_skip_current);
             if (found >= 0) active_panel->selected_index = found;
         }
 
@@ -626,7 +692,7 @@ int main(int argc, char *argv[]) {
         }
 
         // Handle scrolling in command line
-        int max_cmd_display = COLS - (strlen(username) + strlen(unameData.nodename) + strlen(active_panel->path) + 6) - 1;
+        int max_cmd_display = COLS - prompt_length - 3;
         if (cursor_pos - cmd_offset >= max_cmd_display) {
             cmd_offset++;
         } else if (cursor_pos - cmd_offset < 0 && cmd_offset > 0) {
@@ -8,7 +8,7 @@ int panel_mass_action(OperationFunc operation, char *tgt, operationContext *cont
     char source_path[CMD_MAX] = {0};
     char target_path[CMD_MAX] = {0};
     char target[CMD_MAX] = {0};
-    FileNode *unselect_item = NULL;
+    int unselect_index = -1;
 
     WINDOW *saved_screen;
     saved_screen = dupwin(newscr);
@@ -16,26 +16,16 @@ int panel_mass_action(OperationFunc operation, char *tgt, operationContext *cont
     create_progress_dialog(1);
 
     if (active_panel->num_selected_files == 0) {
-
-        FileNode *current = active_panel->files;
-        while (current != NULL) {
-            if (strcmp(current->name, active_panel->file_under_cursor) == 0) {
-                current->is_selected = 1;
-                active_panel->num_selected_files = 1;
-                active_panel->bytes_selected_files = current->size;
-                unselect_item = current;
-                break;
-            }
-            current = current->next;
-        }
+        unselect_index = panel_find_file(active_panel, active_panel->file_under_cursor);
+        panel_select(active_panel, unselect_index, 1);
     }
 
     int initial_num_selected = active_panel->num_selected_files;
 
     // process selected files
-    FileNode *current = active_panel->files;
-    while (current != NULL) {
-        if (current->is_selected) {
+    for (int i = 0; i < active_panel->files_count; i++) {
+        FileNode *current = panel_file(active_panel, i);
+        if (panel_is_selected(active_panel, i)) {
             context->keep_item_selected = 0;
             sprintf(source_path, "%s/%s", active_panel->path, current->name);
 
@@ -56,17 +46,13 @@ int panel_mass_action(OperationFunc operation, char *tgt, operationContext *cont
             err = recursive_operation(source_path, target_path, context, operation);
             if (context->abort == 1) break;
             if (err == OPERATION_OK && context->keep_item_selected == 0) {
-                if (current->is_selected) {
-                    active_panel->num_selected_files--;
-                }
-                current->is_selected = 0;
+                panel_select(active_panel, i, 0);
             }
         }
-        current = current->next;
     }
 
-    if (unselect_item != NULL) {
-        unselect_item->is_selected = 0;
+    if (unselect_index != -1) {
+        panel_select(active_panel, unselect_index, 0);
         active_panel->num_selected_files = 0;
         active_panel->bytes_selected_files = 0;
     }
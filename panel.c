@@ -15,16 +15,6 @@ void shorten(char *name, int width, char *result) {
     }
 }
 
-int file_has_extension(const char *filename, const char *extensions[]) {
-    for (int i = 0; extensions[i]; i++) {
-        if (strcmp(filename + strlen(filename) - strlen(extensions[i]), extensions[i]) == 0) {
-            return 1;
-        }
-    }
-    return 0;
-}
-
-
 int format_number(off_t num, char *str) {
     static char buf[20]; // Assuming number won't exceed 20 characters with commas
     char rev[20], *p = rev;
@@ -69,205 +59,446 @@ void format_size_with_units(off_t size, char *size_str, size_t len, int maxlen)
 
 
 
-void update_panel(WINDOW *win, PanelProp *panel) {
-    FileNode *current = panel->files;
-    int line = 1;  // Start from the second row to avoid the border
+// Formatted columns of entry 'node_index' for a name column 'name_width' wide. They are kept
+// with the listing and formatted again only when size or mtime changed, or a new year started,
+// which turns this year's times into dates. Shortened names are kept for two widths, the panels
+// sharing a listing may differ by a column.
+EntryDisplay *file_list_display(FileList *list, int node_index, int name_width, int current_year) {
+    if (list->display == NULL) {
+        list->display = calloc(list->capacity ? list->capacity : 1, sizeof(EntryDisplay *));
+    }
+
+    EntryDisplay *display = list->display[node_index];
+    if (display == NULL) {
+        display = (EntryDisplay *) arena_alloc(&list->display_arena, sizeof(EntryDisplay));
+        memset(display, 0, sizeof(EntryDisplay));
+        list->display[node_index] = display;
+    }
+
+    FileNode *node = &list->nodes[node_index];
+
+    if (display->size_str[0] == '\0' || display->size != node->size) {
+        char size_str[50];  // room for the digits before they get a unit
+        display->size = node->size;
+        format_size_with_units(node->size, size_str, sizeof(size_str), 7);
+        snprintf(display->size_str, sizeof(display->size_str), "%.8s", size_str);
+    }
+
+    if (display->date_str[0] == '\0' || display->mtime != node->mtime || display->year != current_year) {
+        struct tm *tm = localtime(&node->mtime);
+        display->mtime = node->mtime;
+        display->year = current_year;
+        if (tm->tm_year != current_year) {
+            strftime(display->date_str, sizeof(display->date_str), "%b %d  %Y", tm); // Display year if different
+        } else {
+            strftime(display->date_str, sizeof(display->date_str), "%b %d %H:%M", tm); // Display time if same year
+        }
+    }
+
+    if (display->name_width[0] != name_width && display->name_width[1] != name_width) {
+        int slot = display->name_slot;
+        display->name_slot = !slot;
+        display->name_width[slot] = name_width;
+        if (name_width > 0 && (int) strlen(node->name) > name_width) {
+            if (display->short_size[slot] < name_width + 1) {
+                // rounded up, the arena also holds the structs
+                display->short_size[slot] = (name_width + 1 + 7) & ~7;
+                display->short_name[slot] = arena_alloc(&list->display_arena, display->short_size[slot]);
+            }
+            shorten(node->name, name_width, display->short_name[slot]);
+        } else if (display->short_name[slot] != NULL) {
+            display->short_name[slot][0] = '\0';
+        }
+    }
+
+    return display;
+}
+
+
+// Name of the entry as a name column 'name_width' wide shows it, file_list_display() prepared it
+static const char *entry_display_name(EntryDisplay *display, FileNode *node, int name_width) {
+    int slot = display->name_width[0] == name_width ? 0 : 1;
+    char *short_name = display->short_name[slot];
+    return short_name != NULL && short_name[0] != '\0' ? short_name : node->name;
+}
+
+
+enum {
+    ROW_CURSOR   = 1 << 0,
+    ROW_FOCUSED  = 1 << 1,  // cursor row of the active panel
+    ROW_SELECTED = 1 << 2
+};
+
+
+// Forget what the panel shows, the next update_panel() draws all of it. Needed when the
+// window was created again, or entries changed without moving to other rows.
+void panel_damage(PanelProp *panel) {
+    free(panel->render);
+    panel->render = NULL;
+}
+
+
+// Draw one row of the file list, 'index' is the row in the panel's view, the entry is NULL for an empty row
+static void draw_panel_row(WINDOW *win, PanelProp *panel, int line, int index, FileNode *current, int flags, int current_year) {
     int width = getmaxx(win) - 2;
-    int height = getmaxy(win);
     int name_width = width - 12 - 7 - 3;
-    char info[CMD_MAX];
+    char prefix = ' ';
 
-    // Get the current year
-    time_t now = time(NULL);
-    struct tm *current_tm = localtime(&now);
-    int current_year = current_tm->tm_year;
-
-    // reset color to default
+    // reset default color, rows scrolled in lack the border and separators
     wattron(win, COLOR_PAIR(COLOR_WHITE_ON_BLUE));
     wattroff(win, A_BOLD);
+    mvwaddch(win, line, 0, '|');
+    mvwaddch(win, line, width + 1, '|');
+    mvwaddch(win, line, width - 7 - 12 - 1, '|');
+    mvwaddch(win, line, width - 12, '|');
 
-    // Fill separator columns
-    mvwvline(win, 1, width - 12, '|', height -3);
-    mvwvline(win, 1, width - 7 - 12 - 1, '|', height -3);
-    mvwhline(win, height - 3, 1, '-', width);
+    if (current == NULL) {
+        mvwhline(win, line, 1, ' ', name_width + 1);
+        mvwprintw(win, line, width - 7 - 12, "       ");
+        mvwprintw(win, line, width - 12 + 1, "            ");
+        return;
+    }
 
-    // Header of the file list
-    wattron(win, A_BOLD);
-    wattron(win, COLOR_PAIR(COLOR_YELLOW_ON_BLUE));
-    mvwprintw(win, line, 1, "%*s%s", ((width - 12 - 7 - 2) / 2) - (strlen("Name") / 2), "", "Name");
-    mvwprintw(win, line, width - 12 - 7 + 1, "%s", "Size");
-    mvwprintw(win, line, width - 7 - 4, "%s", "Modify time");
-    wattroff(win, A_BOLD);
+    // colour of the entry's rule, by extension, name or mode
+    if (current->color) {
+        wattron(win, file_color_attrs(current->color));
+    }
 
-    line++;
 
-    // Ignore first items based on the scroll index
-    for (int i = 0; i < panel->scroll_index && current != NULL; i++) {
-        current = current->next;
+    if (current->is_link_broken) {
+        prefix = '!';
+        wattron(win, COLOR_PAIR(COLOR_RED_ON_BLUE));
+        wattron(win, A_BOLD);
+    } else if (current->is_link_to_dir) {
+        prefix = '~';
+        wattron(win, A_BOLD);
+    } else if (current->is_dir) {
+        prefix = '/';
+        wattron(win, A_BOLD);
+    } else if (current->is_link) {
+        prefix = '@';
+    } else if (current->is_device) {
+        prefix = '-';
+        wattron(win, COLOR_PAIR(COLOR_MAGENTA_ON_BLUE));
+        wattron(win, A_BOLD);
+    } else if (current->is_executable) {
+        prefix = '*';
+        wattron(win, COLOR_PAIR(COLOR_GREEN_ON_BLUE));
+        wattron(win, A_BOLD);
     }
 
-    int index = panel->scroll_index;
-    while (current != NULL && line < height - 3) {
-        int is_active_item = (index == panel->selected_index);
-        char prefix = ' ';
+    if (flags & ROW_SELECTED) {
+        wattron(win, COLOR_PAIR(COLOR_YELLOW_ON_BLUE));
+        wattron(win, A_BOLD);
+    }
 
-        // reset default color
-        wattron(win, COLOR_PAIR(COLOR_WHITE_ON_BLUE));
+    int node_index = panel->order ? panel->order[index] : index;
+    EntryDisplay *display = file_list_display(panel->files, node_index, name_width, current_year);
+    const char *size_str = display->size_str;
+
+    int updir = (current->is_dir && strcmp(current->name, "..") == 0);
+    if (updir) {
+       size_str = "UP--DIR";
+    }
+
+    if (flags & ROW_FOCUSED) {
+        wattron(win, COLOR_PAIR(COLOR_BLACK_ON_CYAN));
         wattroff(win, A_BOLD);
 
-        // use some colors for regular files based by extension
-        if (!current->is_dir)
-        {
-           if (file_has_extension(current->name, (const char*[]){".gz",".tar",".xz",NULL})) {
-              wattron(win, COLOR_PAIR(COLOR_MAGENTA_ON_BLUE));
-              wattron(win, A_BOLD);
-           }
-
-           if (file_has_extension(current->name, (const char*[]){".c",".php",".sh",".h",NULL})) {
-              wattron(win, COLOR_PAIR(COLOR_CYAN_ON_BLUE));
-           }
+        mvwprintw(win, line, width - 7 - 12 - 1, "|");
+        mvwprintw(win, line, width - 12, "|");
+
+        if (flags & ROW_SELECTED) {
+           wattron(win, COLOR_PAIR(COLOR_YELLOW_ON_CYAN));
+           wattron(win, A_BOLD);
         }
+    }
 
+    mvwhline(win, line, 1, ' ', name_width + 1);
+    mvwprintw(win, line, 1, "%c", prefix);
 
-        if (current->is_link_broken) {
-            prefix = '!';
-            wattron(win, COLOR_PAIR(COLOR_RED_ON_BLUE));
-            wattron(win, A_BOLD);
-        } else if (current->is_link_to_dir) {
-            prefix = '~';
-            wattron(win, A_BOLD);
-        } else if (current->is_dir) {
-            prefix = '/';
-            wattron(win, A_BOLD);
-        } else if (current->is_link) {
-            prefix = '@';
-        } else if (current->is_device) {
-            prefix = '-';
-            wattron(win, COLOR_PAIR(COLOR_MAGENTA_ON_BLUE));
-            wattron(win, A_BOLD);
-        } else if (current->is_executable) {
-            prefix = '*';
-            wattron(win, COLOR_PAIR(COLOR_GREEN_ON_BLUE));
-            wattron(win, A_BOLD);
-        }
+    mvwaddnstr(win, line, 2, entry_display_name(display, current, name_width), name_width);
 
-        if (current->is_selected) {
-            wattron(win, COLOR_PAIR(COLOR_YELLOW_ON_BLUE));
-            wattron(win, A_BOLD);
-        }
+    mvwprintw(win, line, width - 7 - 12, "%7s", size_str);
+    mvwprintw(win, line, width - 12 + 1, "%12s", display->date_str);
+}
 
-        char date_str[13];
-        struct tm *tm = localtime(&current->mtime);
 
-        if (tm->tm_year != current_year) {
-            strftime(date_str, sizeof(date_str), "%b %d  %Y", tm); // Display year if different
-        } else {
-            strftime(date_str, sizeof(date_str), "%b %d %H:%M", tm); // Display time if same year
-        }
+// Text of the info line for the entry under the cursor
+static void panel_cursor_info(PanelProp *panel, char *info, size_t size) {
+    FileNode *current = panel_file(panel, panel->selected_index);
+    info[0] = '\0';
+    if (current == NULL) return;
 
-        char size_str[50];  // Buffer to hold the size and suffix
-        format_size_with_units(current->size, size_str, sizeof(size_str), 7);
+    if (current->is_dir && strcmp(current->name, "..") == 0) {
+        snprintf(info, size, "UP--DIR");
+    } else if (current->is_link) {
+        snprintf(info, size, "-> %s", current->link_target);
+    } else {
+        char prefix = ' ';
+        if (current->is_link_broken) prefix = '!';
+        else if (current->is_link_to_dir) prefix = '~';
+        else if (current->is_dir) prefix = '/';
+        else if (current->is_device) prefix = '-';
+        else if (current->is_executable) prefix = '*';
+        snprintf(info, size, "%c%s", prefix, current->name);
+    }
+}
 
-        int updir = (current->is_dir && strcmp(current->name, "..") == 0);
-        if (updir) {
-           snprintf(size_str, sizeof(size_str), "UP--DIR");
-        }
 
-        if (is_active_item) {
-            if (updir) {
-                snprintf(info, sizeof(info), "UP--DIR");
-            } else if (current->is_link) {
-                snprintf(info, sizeof(info), "-> %s", current->link_target);
-            } else {
-                snprintf(info, sizeof(info), "%c%s", prefix, current->name);
-            }
+// Draw the panel. Only rows whose entry or state changed since the last call are drawn,
+// and when the list scrolled by a few rows the window is scrolled instead of drawing them all.
+void update_panel(WINDOW *win, PanelProp *panel) {
+    int width = getmaxx(win) - 2;
+    int height = getmaxy(win);
+    int name_width = width - 12 - 7 - 3;
+    int rows = height - 5;
+    char info[CMD_MAX];
 
-            if (panel == active_panel) {
-                wattron(win, COLOR_PAIR(COLOR_BLACK_ON_CYAN));
-                wattroff(win, A_BOLD);
+    // Get the current year
+    time_t now = time(NULL);
+    struct tm *current_tm = localtime(&now);
+    int current_year = current_tm->tm_year;
 
-                mvwprintw(win, line, width - 7 - 12 - 1, "|");
-                mvwprintw(win, line, width - 12, "|");
+    PanelRender *render = panel->render;
+    if (render != NULL && (render->width != width || render->height != height)) {
+        panel_damage(panel);
+        render = NULL;
+    }
 
-                if (current->is_selected) {
-                   wattron(win, COLOR_PAIR(COLOR_YELLOW_ON_CYAN));
-                   wattron(win, A_BOLD);
-                }
-           }
-        }
+    if (render == NULL) {
+        render = calloc(1, sizeof(PanelRender) + (rows > 0 ? rows : 0) * sizeof(RenderedRow));
+        render->width = width;
+        render->height = height;
+        render->rows = rows > 0 ? rows : 0;
+        render->scroll_index = panel->scroll_index;
+        render->loading = -1;
+        render->title_active = -1;
+        for (int i = 0; i < render->rows; i++) render->row[i].node = -2;
+        panel->render = render;
+        touchwin(win);
+
+        // reset color to default
+        wattron(win, COLOR_PAIR(COLOR_WHITE_ON_BLUE));
+        wattroff(win, A_BOLD);
 
-        mvwhline(win, line, 1, ' ', name_width + 1);
-        mvwprintw(win, line, 1, "%c", prefix);
+        // Fill separator columns
+        mvwvline(win, 1, width - 12, '|', height -3);
+        mvwvline(win, 1, width - 7 - 12 - 1, '|', height -3);
+        mvwhline(win, height - 3, 1, '-', width);
+    }
 
-        mvwaddnstr(win, line, 2, SHORTEN(current->name, name_width), name_width);
+    // Header of the file list
+    if (render->loading != panel->loading) {
+        render->loading = panel->loading;
+        wattron(win, A_BOLD);
+        wattron(win, COLOR_PAIR(COLOR_YELLOW_ON_BLUE));
+        mvwhline(win, 1, 1, ' ', name_width + 1);
+        if (panel->loading > 0) {
+            char loading[64];
+            snprintf(loading, sizeof(loading), "Loading %d entries", panel->loading);
+            int pad = (name_width + 1 - (int)strlen(loading)) / 2;
+            mvwaddnstr(win, 1, 1 + (pad > 0 ? pad : 0), loading, name_width + 1);
+        } else {
+            mvwprintw(win, 1, 1, "%*s%s", ((width - 12 - 7 - 2) / 2) - (strlen("Name") / 2), "", "Name");
+        }
+        mvwprintw(win, 1, width - 12 - 7 + 1, "%s", "Size");
+        mvwprintw(win, 1, width - 7 - 4, "%s", "Modify time");
+        wattroff(win, A_BOLD);
+    }
 
-        mvwprintw(win, line, width - 7 - 12, "%7s", size_str);
-        mvwprintw(win, line, width - 12 + 1, "%12s", date_str);
+    // the list moved by a few rows, move what is on screen along and draw only the rows scrolled in
+    int shift = panel->scroll_index - render->scroll_index;
+    if (shift != 0 && abs(shift) < render->rows / 2) {
+        wsetscrreg(win, 2, 2 + render->rows - 1);
+        scrollok(win, TRUE);
+        wscrl(win, shift);
+        scrollok(win, FALSE);
+        wsetscrreg(win, 0, height - 1);
+
+        if (shift > 0) {
+            memmove(&render->row[0], &render->row[shift], (render->rows - shift) * sizeof(RenderedRow));
+            for (int i = render->rows - shift; i < render->rows; i++) render->row[i].node = -2;
+        } else {
+            memmove(&render->row[-shift], &render->row[0], (render->rows + shift) * sizeof(RenderedRow));
+            for (int i = 0; i < -shift; i++) render->row[i].node = -2;
+        }
+    }
+    render->scroll_index = panel->scroll_index;
+
+    // Start right at the first item visible with the scroll index
+    resolve_panel_files(panel, panel->scroll_index, rows, SCAN_NEED_DISPLAY);
+    for (int row = 0; row < render->rows; row++) {
+        int index = panel->scroll_index + row;
+        FileNode *current = panel_file(panel, index);
+        RenderedRow state = {-1, 0, 0};
+
+        if (current != NULL) {
+            state.node = panel->order ? panel->order[index] : index;
+            if (index == panel->selected_index) state.flags |= ROW_CURSOR;
+            if (index == panel->selected_index && panel == active_panel) state.flags |= ROW_FOCUSED;
+            if (panel_is_selected(panel, index)) state.flags |= ROW_SELECTED;
+            state.resolved = current->resolved;
+        }
 
-        line++;
-        index++;
-        current = current->next;
+        RenderedRow *drawn = &render->row[row];
+        if (drawn->node == state.node && drawn->flags == state.flags && drawn->resolved == state.resolved) continue;
+        render->row[row] = state;
+        draw_panel_row(win, panel, 2 + row, index, current, state.flags, current_year);
     }
 
     // path goes to window title
-    if ((win == win1 && active_panel == &left_panel) || (win == win2 && active_panel == &right_panel)) {
-       wattron(win, COLOR_PAIR(COLOR_BLACK_ON_WHITE));
-    } else {
-       wattron(win, COLOR_PAIR(COLOR_WHITE_ON_BLUE));
-    }
-    wattroff(win, A_BOLD);
-    mvwprintw(win, 0, 3, " %s ", SHORTEN(panel->path, name_width + 12 + 7 - 2));
+    int title_active = (win == win1 && active_panel == &left_panel) || (win == win2 && active_panel == &right_panel);
+    if (render->title_active != title_active || strcmp(render->title, panel->path) != 0) {
+        render->title_active = title_active;
+        snprintf(render->title, sizeof(render->title), "%s", panel->path);
 
-    // reset color to default
-    wattron(win, COLOR_PAIR(COLOR_WHITE_ON_BLUE));
+        if (title_active) {
+           wattron(win, COLOR_PAIR(COLOR_BLACK_ON_WHITE));
+        } else {
+           wattron(win, COLOR_PAIR(COLOR_WHITE_ON_BLUE));
+        }
+        wattroff(win, A_BOLD);
+        mvwprintw(win, 0, 3, " %s ", SHORTEN(panel->path, name_width + 12 + 7 - 2));
 
-    mvwhline(win, 0, strlen(panel->path) + 5, '-', width - strlen(panel->path) - 4);
+        // reset color to default
+        wattron(win, COLOR_PAIR(COLOR_WHITE_ON_BLUE));
 
-    while(line < height - 3) {
-        mvwhline(win, line, 1, ' ', name_width + 1);
-        mvwprintw(win, line, width - 7 - 12, "       ");
-        mvwprintw(win, line, width - 12 + 1, "            ");
-        line++;
+        mvwhline(win, 0, strlen(panel->path) + 5, '-', width - strlen(panel->path) - 4);
     }
 
+    // search or filter input, loading hint, or info for active file
+    const char search_prompt[] = "/*~";  // by SearchKinds: prefix, substring, fuzzy
+    const char *filter_prompt[] = {"Filter: ", "Filter regex: "};  // by FilterKinds
+    char footer[sizeof(render->footer)];
     if (panel->search_mode == 1) {
-        // search input
-        wattron(win, COLOR_PAIR(COLOR_BLACK_ON_CYAN));
-        mvwprintw(win, height - 2, 1, "/%-*s", width - 1, panel->search_text);
-        wattron(win, COLOR_PAIR(COLOR_WHITE_ON_BLUE));
+        snprintf(footer, sizeof(footer), "%c%s", search_prompt[panel->search_kind], panel->search_text);
+    } else if (panel->filter_mode) {
+        snprintf(footer, sizeof(footer), "%s%s", filter_prompt[panel->filter_kind], panel->filter_text);
+    } else if (panel->loading > 0) {
+        snprintf(footer, sizeof(footer), "%s", "Press Esc to cancel loading");
     } else {
-        // print info for active file
-        mvwprintw(win, height - 2, 1, "%-*s", width, SHORTEN(info,width));
+        panel_cursor_info(panel, info, sizeof(info));
+        snprintf(footer, sizeof(footer), "%s", info);
+    }
+    if (strcmp(render->footer, footer) != 0 || render->footer[0] == '\0') {
+        snprintf(render->footer, sizeof(render->footer), "%s", footer);
+        if (panel->search_mode == 1) {
+            wattron(win, COLOR_PAIR(COLOR_BLACK_ON_CYAN));
+            mvwprintw(win, height - 2, 1, "%c%-*s", search_prompt[panel->search_kind], width - 1, panel->search_text);
+            wattron(win, COLOR_PAIR(COLOR_WHITE_ON_BLUE));
+        } else if (panel->filter_mode) {
+            wattron(win, COLOR_PAIR(COLOR_BLACK_ON_CYAN));
+            mvwprintw(win, height - 2, 1, "%-*.*s", width, width, footer);
+            wattron(win, COLOR_PAIR(COLOR_WHITE_ON_BLUE));
+        } else {
+            wattron(win, COLOR_PAIR(COLOR_WHITE_ON_BLUE));
+            wattroff(win, A_BOLD);
+            mvwprintw(win, height - 2, 1, "%-*s", width, SHORTEN(footer, width));
+        }
     }
 
+    // print selected, and the filter in effect
+    char summary[sizeof(render->summary)] = "";
+    if (panel->num_selected_files > 0) {
+        char num[20];
+        format_number(panel->bytes_selected_files, num);
+        snprintf(summary, sizeof(summary), " %s B in %d file%s ", num, panel->num_selected_files, panel->num_selected_files == 1 ? "" : "s");
+    }
+    const char *filter = panel->filter ? panel->filter : "";
+    if (strcmp(render->summary, summary) != 0 || strcmp(render->filter, filter) != 0) {
+        snprintf(render->summary, sizeof(render->summary), "%s", summary);
+        snprintf(render->filter, sizeof(render->filter), "%s", filter);
+        wattron(win, COLOR_PAIR(COLOR_WHITE_ON_BLUE));
+        wattroff(win, A_BOLD);
+        mvwhline(win, height - 3, 1, '-', width);
+        wattron(win, COLOR_PAIR(COLOR_YELLOW_ON_BLUE));
+        wattron(win, A_BOLD);
+        int room = width - (int) strlen(summary) - 6;
+        if (filter[0] && room > 0) {
+            snprintf(info, sizeof(info), " %s%s ", panel->filter_by == FILTER_REGEX ? "regex " : "", filter);
+            mvwaddnstr(win, height - 3, 2, info, room);
+        }
+        if (summary[0]) mvwprintw(win, height - 3, width - strlen(summary) - 3, "%s", summary);
+        wattroff(win, A_BOLD);
+    }
 
-    // print selected
-    wattron(win, COLOR_PAIR(COLOR_YELLOW_ON_BLUE));
-    wattron(win, A_BOLD);
-    char num[20];
-    format_number(panel->bytes_selected_files, num);
-    sprintf(info," %s B in %d file%s ", num, panel->num_selected_files, panel->num_selected_files == 1 ? "" : "s");
-    if (panel->num_selected_files > 0) mvwprintw(win, height - 3, width - strlen(info) - 3, "%s", info);
-    wattroff(win, A_BOLD);
-
-    wrefresh(win);
+    // goes to the terminal with the rest of the frame on doupdate()
+    wnoutrefresh(win);
     cursor_to_cmd();
 }
 
 
+WINDOW *panel_window(PanelProp *panel) {
+    return panel == &left_panel ? win1 : win2;
+}
+
+
+// Draw the entries loaded so far while a big directory is being read.
+// Returns 1 if the user pressed Esc (or F10) to cancel loading.
+int show_loading_progress(PanelProp *panel) {
+    WINDOW *win = panel_window(panel);
+    if (win == NULL) return 0; // still starting up, nothing to draw into
+
+    // partial list is shown from its top, keep the real cursor for when loading is done
+    int selected_index = panel->selected_index;
+    int scroll_index = panel->scroll_index;
+    panel->selected_index = 0;
+    panel->scroll_index = 0;
+    update_panel(win, panel);
+    doupdate();
+    panel->selected_index = selected_index;
+    panel->scroll_index = scroll_index;
+
+    // look for F10 or a lone Esc among all keys typed so far, the others are put back in their
+    // order for the panel once it loaded. Keys typed before a cancel go with it, and so do keys
+    // beyond LOADING_TYPEAHEAD_MAX, with a beep.
+    int keys[LOADING_TYPEAHEAD_MAX];
+    int key_count = 0;
+    int dropped = 0;
+    int cancel = 0;
+    int resized = 0;
+    int ch;
+    timeout(0);
+    while ((ch = getch()) != ERR) {
+        if (ch == KEY_RESIZE) {
+            resized = 1;
+            continue;
+        }
+        if (ch == KEY_F(10)) {
+            cancel = 1;
+            break;
+        }
+        int next = ERR;
+        if (ch == 27) {
+            next = getch();
+            if (next == ERR) {  // lone Esc, not an Alt+key sequence
+                cancel = 1;
+                break;
+            }
+        }
+        if (key_count + (next != ERR) >= LOADING_TYPEAHEAD_MAX) {
+            dropped = 1;
+            continue;
+        }
+        keys[key_count++] = ch;
+        if (next != ERR) keys[key_count++] = next;
+    }
+    timeout(-1);
+    if (dropped && !cancel) beep();
+    if (cancel) key_count = 0;
+    while (key_count > 0) ungetch(keys[--key_count]);
+    if (resized) ungetch(KEY_RESIZE);
+
+    return cancel;
+}
+
+
 void update_panel_cursor() {
    if (strlen(active_panel->file_under_cursor) >0) {
        // Search for the last selected item and set it as the active item
-       FileNode *node = active_panel->files;
-       int index = 0;
-       while (node) {
-           if (strcmp(node->name, active_panel->file_under_cursor) == 0) {
-               active_panel->selected_index = index;
-               break;
-           }
-           node = node->next;
-           index++;
-       }
+       int index = panel_find_file(active_panel, active_panel->file_under_cursor);
+       if (index >= 0) active_panel->selected_index = index;
    } else {
        active_panel->selected_index = 0;
    }
@@ -278,7 +509,16 @@ void update_panel_cursor() {
 void update_files_in_both_panels() {
     update_panel_files(&left_panel);
     update_panel_files(&right_panel);
-    sort_file_nodes(&left_panel.files, left_panel.sort_order);
-    sort_file_nodes(&right_panel.files, right_panel.sort_order);
+    update_panel_cursor();
+}
+
+
+// Bring both panels up to date after an operation or a shell command. Panels with a working
+// directory watch only re-read the files that changed, the others are read again from scratch.
+void refresh_files_in_both_panels() {
+    watch_read_events();
+    if (left_panel.watch_wd == 0) left_panel.watch_rescan = 1;
+    if (right_panel.watch_wd == 0) right_panel.watch_rescan = 1;
+    watch_apply_both_panels();
     update_panel_cursor();
 }
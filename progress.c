@@ -178,3 +178,10 @@ int update_progress_dialog_delta(char *title, int current_progress, int total_pr
     return -1;
 }
 
+
+// Microseconds passed since 'start', measured on the monotonic clock
+long elapsed_us(struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_nsec - start->tv_nsec) / 1000;
+}
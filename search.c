@@ -0,0 +1,145 @@
+#include "includes.h"
+#include "types.h"
+#include "globals.h"
+
+// Quick search (Alt+s) moves the cursor to the next entry whose name matches what was typed.
+// Prefix queries are binary searched in the listing's names sorted by byte order, substring and
+// fuzzy queries scan all names with strstr() and a subsequence test. The entries which matched
+// are kept, so a query extended by a typed character only checks those again.
+
+
+void panel_forget_search(PanelProp *panel) {
+    free(panel->search_matched);
+    free(panel->search_matches);
+    panel->search_matched = NULL;
+    panel->search_matches = NULL;
+    panel->search_match_count = 0;
+}
+
+
+// The characters of 'query' appear in 'name' in the same order, ignoring case
+static int fuzzy_match(const char *name, const char *query) {
+    for (; *query; query++) {
+        int ch = tolower((unsigned char) *query);
+        while (*name && tolower((unsigned char) *name) != ch) name++;
+        if (*name == '\0') return 0;
+        name++;
+    }
+    return 1;
+}
+
+
+static int search_match(SearchKinds kind, const char *name, const char *query, size_t query_len) {
+    switch (kind) {
+        case SEARCH_SUBSTRING:
+            return strstr(name, query) != NULL;
+        case SEARCH_FUZZY:
+            return fuzzy_match(name, query);
+        default:
+            return strncmp(name, query, query_len) == 0;
+    }
+}
+
+
+// First position in the sorted 'name_order' whose name is above 'query' in its first 'query_len'
+// bytes, or with 'upper' 0 the first one which is not below it
+static int name_order_bound(FileList *list, int *name_order, int count, const char *query, size_t query_len, int upper) {
+    int low = 0, high = count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        int cmp = strncmp(list->nodes[name_order[mid]].name, query, query_len);
+        if (cmp < 0 || (upper && cmp == 0)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+
+// Find the entries matching the panel's search text, from the previous matches if the text only got longer.
+// Prefix matches are a range of the names sorted by byte order and keep that order.
+static void search_find_matches(PanelProp *panel) {
+    FileList *list = panel->files;
+    const char *query = panel->search_text;
+    size_t query_len = strlen(query);
+
+    if (panel->search_matched != NULL && strcmp(panel->search_matched, query) == 0) return;
+
+    int narrowing = panel->search_matched != NULL && panel->search_matched[0] != '\0' && strncmp(query, panel->search_matched, strlen(panel->search_matched)) == 0;
+    int count = 0;
+
+    if (panel->search_kind == SEARCH_PREFIX) {
+        int *names = narrowing ? panel->search_matches : file_list_name_order(list);
+        int names_count = narrowing ? panel->search_match_count : list->count;
+        int first = name_order_bound(list, names, names_count, query, query_len, 0);
+        count = name_order_bound(list, names + first, names_count - first, query, query_len, 1);
+
+        if (!narrowing) {
+            free(panel->search_matches);
+            panel->search_matches = malloc(count * sizeof(int) + 1);
+        }
+        memmove(panel->search_matches, names + first, count * sizeof(int));
+    } else if (narrowing && panel->search_match_count < list->count / 2) {  // else a scan in node order is faster
+        for (int i = 0; i < panel->search_match_count; i++) {
+            int node_index = panel->search_matches[i];
+            if (search_match(panel->search_kind, list->nodes[node_index].name, query, query_len)) {
+                panel->search_matches[count++] = node_index;
+            }
+        }
+    } else {
+        free(panel->search_matches);
+        panel->search_matches = malloc(list->count * sizeof(int) + 1);
+        for (int i = 0; i < list->count; i++) {
+            if (search_match(panel->search_kind, list->nodes[i].name, query, query_len)) {
+                panel->search_matches[count++] = i;
+            }
+        }
+    }
+
+    panel->search_match_count = count;
+    free(panel->search_matched);
+    panel->search_matched = strdup(query);
+}
+
+
+// Row of the first entry matching the panel's search text from the cursor on, or from the row
+// after it with 'skip_current', starting over at the top when there is none below. -1 if nothing matches.
+// A few matches are looked up by their row, many are marked and the rows are walked from the cursor.
+int panel_quick_search(PanelProp *panel, int skip_current) {
+    if (panel->files == NULL) return -1;
+
+    search_find_matches(panel);
+
+    int start = panel->selected_index + (skip_current ? 1 : 0);
+    int below = -1, above = -1;
+
+    if (panel->search_match_count <= SEARCH_ROW_LOOKUPS) {
+        for (int i = 0; i < panel->search_match_count; i++) {
+            int row = panel_row_of(panel, panel->search_matches[i]);
+            if (row < 0) continue;
+            if (row >= start) {
+                if (below == -1 || row < below) below = row;
+            } else if (above == -1 || row < above) {
+                above = row;
+            }
+        }
+        return below >= 0 ? below : above;
+    }
+
+    unsigned char *matching = calloc((panel->files->count + 7) / 8, 1);
+    for (int i = 0; i < panel->search_match_count; i++) {
+        int node_index = panel->search_matches[i];
+        matching[node_index / 8] |= 1 << (node_index % 8);
+    }
+
+    int found = -1;
+    for (int n = 0; n < panel->files_count && found < 0; n++) {
+        int row = (start + n) % panel->files_count;
+        int node_index = panel->order ? panel->order[row] : row;
+        if (matching[node_index / 8] & (1 << (node_index % 8))) found = row;
+    }
+    free(matching);
+    return found;
+}
@@ -0,0 +1,111 @@
+#include "includes.h"
+#include "types.h"
+#include "globals.h"
+
+// Worker threads used to resolve entry metadata in parallel on high latency filesystems
+// (NFS, FUSE, ...), where every stat call is a network round trip.
+// The pool is started on first use and its threads stay parked between scans.
+
+static pthread_t stat_workers[STAT_POOL_WORKERS];
+static int stat_workers_started = 0;
+
+static pthread_mutex_t stat_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stat_pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t stat_pool_done = PTHREAD_COND_INITIALIZER;
+
+static ScanBatch *stat_pool_batch = NULL;  // batch being resolved, NULL when idle
+static int stat_pool_next = 0;             // next entry of the batch nobody claimed yet
+static int stat_pool_busy = 0;             // workers currently inside the batch
+
+
+// Claim entries of the current batch one by one until it is exhausted.
+// Must be called with stat_pool_lock held, returns with it held.
+static void stat_pool_drain(ScanBatch *batch) {
+    while (stat_pool_next < batch->count) {
+        int i = stat_pool_next++;
+        pthread_mutex_unlock(&stat_pool_lock);
+        FileNode *node = &batch->list->nodes[batch->first + i];
+        if (!node->resolved) scan_entry(batch->dir_fd, node->name, batch->d_types[i], batch->fields, batch->list, node);
+        pthread_mutex_lock(&stat_pool_lock);
+    }
+}
+
+
+static void *stat_pool_worker(void *arg) {
+    pthread_mutex_lock(&stat_pool_lock);
+    while (1) {
+        while (stat_pool_batch == NULL || stat_pool_next >= stat_pool_batch->count) {
+            pthread_cond_wait(&stat_pool_work, &stat_pool_lock);
+        }
+        ScanBatch *batch = stat_pool_batch;
+        stat_pool_busy++;
+        stat_pool_drain(batch);
+        stat_pool_busy--;
+        if (stat_pool_busy == 0) pthread_cond_signal(&stat_pool_done);
+    }
+    return NULL;
+}
+
+
+static int stat_pool_start() {
+    if (stat_workers_started > 0) return stat_workers_started;
+
+    // keep terminal signals (SIGWINCH, ...) on the main thread
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (int i = 0; i < STAT_POOL_WORKERS; i++) {
+        if (pthread_create(&stat_workers[i], NULL, stat_pool_worker, NULL) != 0) break;
+        pthread_detach(stat_workers[i]);
+        stat_workers_started++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    return stat_workers_started;
+}
+
+
+// Resolve entries [first, batch->count) of the batch on the worker pool, the calling thread helps too
+static void stat_pool_run(ScanBatch *batch, int first) {
+    pthread_mutex_lock(&stat_pool_lock);
+    stat_pool_batch = batch;
+    stat_pool_next = first;
+    pthread_cond_broadcast(&stat_pool_work);
+
+    stat_pool_drain(batch);
+    while (stat_pool_busy > 0) {
+        pthread_cond_wait(&stat_pool_done, &stat_pool_lock);
+    }
+    stat_pool_batch = NULL;
+    pthread_mutex_unlock(&stat_pool_lock);
+}
+
+
+// Resolve metadata of all entries in the batch.
+// The first entries of every directory are stat'ed one after another while measuring how long
+// each lookup takes; once the average is over STAT_POOL_LATENCY_US the rest of the directory
+// goes to the worker pool. Local filesystems answer in microseconds and never pay for threads.
+// Entries which are resolved already are skipped.
+void scan_batch(ScanBatch *batch) {
+    int i = 0;
+
+    while (i < batch->count && !batch->parallel) {
+        FileNode *node = &batch->list->nodes[batch->first + i];
+        if (node->resolved) {  // the scan resolved it already, like entries the panel's filter hides
+            i++;
+            continue;
+        }
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        scan_entry(batch->dir_fd, node->name, batch->d_types[i], batch->fields, batch->list, node);
+        batch->probe_us += elapsed_us(&start);
+        i++;
+
+        if (++batch->probed == STAT_POOL_PROBE_ENTRIES) {
+            batch->parallel = batch->probe_us / batch->probed > STAT_POOL_LATENCY_US && stat_pool_start() > 0;
+        }
+    }
+
+    if (i < batch->count) stat_pool_run(batch, i);
+}
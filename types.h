@@ -3,8 +3,30 @@
 #define KEY_ALT_ENTER    0507  /* custom alt-enter key */
 #define KEY_ALT_a        0506  /* custom alt-a key */
 #define KEY_ALT_s        0505  /* custom alt-s key */
+#define KEY_ALT_f        0503  /* custom alt-f key */
 #define KEY_SHIFT_F7     0504  /* custom shift+f7 key */
 
+#define STAT_POOL_WORKERS       16   /* threads resolving metadata on slow filesystems */
+#define STAT_POOL_PROBE_ENTRIES 32   /* entries stat'ed in sequence to measure latency */
+#define STAT_POOL_LATENCY_US    50   /* average stat latency which turns the pool on */
+#define LOADING_REDRAW_MS       50   /* redraw interval of a panel while a directory loads */
+#define LOADING_TYPEAHEAD_MAX   64   /* keys typed while a directory loads kept for afterwards */
+#define WATCH_SETTLE_MS         100  /* collect file system events this long before redrawing */
+#define WATCH_MAX_PENDING       256  /* changed names per panel, above that rescan the directory */
+#define DIR_CACHE_SIZE          16   /* listings of recently left directories kept in memory */
+#define ARENA_BLOCK_SIZE        (256 * 1024)  /* strings of a listing are allocated in blocks this big */
+#define SORT_INSERTION_RUN      16   /* runs of keys this short are insertion sorted */
+#define SORT_PARALLEL_MIN       100000  /* entries from which sorting is spread over threads */
+#define SORT_MAX_THREADS        32   /* threads sorting one listing at most */
+#define SORT_INCREMENTAL_PERCENT 10  /* a re-read directory is sorted from scratch when more changed */
+#define SORT_VIEWS_KEPT         4    /* views in other sort orders a panel keeps for switching back */
+#define FRAME_RATE              60   /* frames drawn per second at most, unless changed with --fps */
+#define SEARCH_ROW_LOOKUPS      4096 /* quick search matches looked up by row, more are found walking the rows */
+#define EVENT_SOURCES_MAX       32   /* descriptors the main loop waits on besides the terminal */
+#define JOBS_KEPT               8    /* background jobs whose output is kept for Ctrl+O */
+#define JOB_OUTPUT_LINES        10000 /* output lines kept per job, older ones are dropped */
+#define JOB_EXIT_POLL_MS        200  /* how often a job is checked for its exit where there is no pidfd */
+
 typedef enum {
     SORT_BY_NAME_ASC = 0,
     SORT_BY_SIZE_ASC,
@@ -17,26 +39,170 @@ typedef enum {
     SORT_BY_TIME_DIRSFIRST_ASC,
     SORT_BY_NAME_DIRSFIRST_DESC,
     SORT_BY_SIZE_DIRSFIRST_DESC,
-    SORT_BY_TIME_DIRSFIRST_DESC
+    SORT_BY_TIME_DIRSFIRST_DESC,
+    SORT_BY_NATURAL_DIRSFIRST_ASC,    // digit runs compare by their value, "log2" before "log10"
+    SORT_BY_NATURAL_DIRSFIRST_DESC,
+    SORT_BY_NOCASE_DIRSFIRST_ASC,     // ASCII letters compare regardless of their case
+    SORT_BY_NOCASE_DIRSFIRST_DESC,
+    SORT_BY_LOCALE_DIRSFIRST_ASC,     // strcoll() order of LC_COLLATE
+    SORT_BY_LOCALE_DIRSFIRST_DESC,
+    SORT_BY_EXTENSION_DIRSFIRST_ASC,  // by the part after the last dot, then by name
+    SORT_BY_EXTENSION_DIRSFIRST_DESC
 } SortOrders;
 
+// What a sort order compares, without its direction and dirs-first flag
+typedef enum {
+    SORT_NAME = 0,
+    SORT_SIZE,
+    SORT_TIME,
+    SORT_NATURAL,  // the ones from here on compare collation keys of the names
+    SORT_NOCASE,
+    SORT_LOCALE,
+    SORT_EXTENSION
+} SortKinds;
+
+// How quick search (Alt+s) matches names, Ctrl+T switches while searching
+typedef enum {
+    SEARCH_PREFIX = 0,
+    SEARCH_SUBSTRING,
+    SEARCH_FUZZY  // the typed characters appear in this order, regardless of case
+} SearchKinds;
+
+// How the panel filter (Alt+f) matches names, Ctrl+T switches while typing it
+typedef enum {
+    FILTER_GLOB = 0,  // fnmatch() pattern, matching anywhere in a name
+    FILTER_REGEX      // POSIX extended regular expression
+} FilterKinds;
+
+// Metadata a directory scan has to provide for each entry
+typedef enum {
+    SCAN_NEED_TYPE  = 1 << 0,  // is_dir, is_link, is_device
+    SCAN_NEED_MODE  = 1 << 1,  // permission bits, for is_executable
+    SCAN_NEED_SIZE  = 1 << 2,
+    SCAN_NEED_MTIME = 1 << 3,
+    SCAN_NEED_LINK  = 1 << 4,  // link target, and whether the link is broken
+    SCAN_NEED_LINK_TYPE = 1 << 5,  // whether a link points to a directory
+    SCAN_NEED_DISPLAY = (1 << 6) - 1  // everything a panel row shows
+} ScanFields;
+
 typedef struct FileNode {
     char* name;
+    char* link_target;
     time_t mtime;
     off_t size;
     mode_t chmod;
     uid_t chown;
-    int is_dir;
-    int is_executable;
-    int is_link;
-    int is_link_to_dir;  // link points to a directory
-    int is_link_broken; // invalid link
-    int is_device;
-    char* link_target;
-    int is_selected; // with Insert key
-    struct FileNode *next;
+    unsigned int is_dir : 1;
+    unsigned int is_executable : 1;
+    unsigned int is_link : 1;
+    unsigned int is_link_to_dir : 1;  // link points to a directory
+    unsigned int is_link_broken : 1; // invalid link
+    unsigned int is_device : 1;
+    unsigned int resolved : 6;  // ScanFields the attributes above are valid for
+    unsigned int color : 5;  // colour rule of colors.c the entry matches, 0 for none
 } FileNode;
 
+// Chunk of memory the names and link targets of a listing are packed into
+typedef struct ArenaBlock {
+    struct ArenaBlock *prev;
+    size_t used;
+    size_t size;
+    char data[];
+} ArenaBlock;
+
+// Strings a panel row shows for an entry, formatted once and kept while what they show does not change
+typedef struct EntryDisplay {
+    off_t size;        // size the size column was formatted from
+    time_t mtime;      // mtime and current year the date column was formatted for
+    int year;
+    int name_width[2];    // widths of the name columns short_name was made for, 0 if not yet, one per panel
+    char *short_name[2];  // name shortened to name_width, empty when it fits, NULL until needed
+    int short_size[2];    // bytes short_name has room for, reused when its width changes
+    int name_slot;        // slot the next width takes
+    char size_str[9];  // empty until formatted, 8 characters at most: "8388607T" for the largest off_t
+    char date_str[13];
+} EntryDisplay;
+
+// Entries of one directory in a single array, all their strings are freed at once with the arena.
+// Panels showing the same directory share one listing, each sorts and selects it in its own view.
+typedef struct FileList {
+    FileNode *nodes;
+    int count;
+    int capacity;
+    int refs;    // panels and cache entries holding the listing
+    int fields;  // ScanFields resolved for every entry the panel's filter did not hide, others only for entries shown so far
+    ArenaBlock *arena;
+    int *index;       // name hash table with open addressing, node index + 1 per slot, 0 if empty
+    int index_size;   // slots, a power of two
+    int indexed;      // entries [0, indexed) are in the index, later ones are added on the next lookup
+    char **collation;        // collation key per entry for collation_kind, NULL where not computed yet
+    SortKinds collation_kind;
+    ArenaBlock *collation_arena;  // the keys, freed when another kind is needed
+    EntryDisplay **display;    // formatted columns per entry, NULL where not shown yet
+    int *name_order;  // all entries sorted by strcmp() of their names, NULL until quick search needs it
+    ArenaBlock *display_arena;  // the EntryDisplay structs and short names
+} FileList;
+
+// Sort key of one entry, packed so sorting does not touch the nodes
+typedef struct SortKey {
+    uint64_t value;  // size, mtime or 8 bytes of the name or its collation key big endian, inverted for DESC orders
+    uint64_t next;   // the following 8 bytes, for sorting names which share the first 8
+    int group;       // 0 for directories when they sort first, 1 for everything else
+    int node;        // index in FileList.nodes
+} SortKey;
+
+// Handler of an event source of the main loop, called with the readable descriptor
+typedef void (*EventHandler)(int fd, void *arg);
+
+// Entries of one getdents64() batch waiting for their metadata
+typedef struct ScanBatch {
+    int dir_fd;
+    int fields;
+    FileList *list;
+    int first;       // index of the batch's first entry in list->nodes
+    int count;
+    unsigned char *d_types;
+    int probed;      // entries of the directory stat'ed while measuring latency
+    long probe_us;   // total time spent on them
+    int parallel;    // directory is slow, use the worker pool
+} ScanBatch;
+
+// Identifies a directory and its state, a listing is still valid while this did not change
+typedef struct DirKey {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    struct timespec ctime;
+} DirKey;
+
+// What a row of a panel's file list shows, it is drawn again only when this changes
+typedef struct RenderedRow {
+    int node;   // entry index in files, -1 for an empty row, -2 for a row which has to be drawn
+    int flags;  // ROW_* of panel.c
+    int resolved;  // ScanFields the entry had, rows drawn before attributes arrived are drawn again
+} RenderedRow;
+
+// What update_panel() drew last time into the panel's window
+typedef struct PanelRender {
+    int width;
+    int height;
+    int scroll_index;
+    int loading;          // entry count the header shows, 0 for the column names
+    int title_active;
+    char title[CMD_MAX];  // path as shown in the window's top border
+    char footer[CMD_MAX + 16];  // search or filter prompt followed by the typed text
+    char summary[128];    // selected files on the bottom separator
+    char filter[CMD_MAX]; // filter in effect, also on the bottom separator
+    int rows;
+    RenderedRow row[];
+} PanelRender;
+
+// A panel's view of its listing in a sort order it showed before
+typedef struct SortedView {
+    SortOrders sort_order;
+    int *order;  // NULL for an unused slot
+} SortedView;
+
 typedef struct PanelProp {
     int selected_index;
     int scroll_index;
@@ -46,10 +212,37 @@ typedef struct PanelProp {
     int num_selected_files;
     off_t bytes_selected_files;
     int files_count;
+    int loading;  // entries read so far while a directory is loading, 0 when idle
+    int incomplete;  // loading was cancelled, the listing lacks entries and is neither cached nor shared
     int search_mode;
     char search_text[CMD_MAX];
     char prev_search_text[CMD_MAX];
-    FileNode *files;
+    SearchKinds search_kind;
+    char *search_matched;  // query search_matches were found for, NULL when they have to be found again
+    int *search_matches;   // entries matching it, by their index in files
+    int search_match_count;
+    int filter_mode;  // the filter is being typed in the footer
+    char filter_text[CMD_MAX];  // filter as typed
+    FilterKinds filter_kind;    // how filter_text matches
+    char *filter;  // filter the view is built with, NULL for all entries, the last valid filter_text
+    FilterKinds filter_by;
+    char *filter_glob;     // FILTER_GLOB: the filter between '*'s, NULL without wildcards
+    regex_t filter_regex;  // FILTER_REGEX: the filter compiled
+    FileList *files;
+    int *order;  // the panel's sorted view of files, order[i] is the entry shown on row i
+    SortOrders sorted_by;  // sort order the view was built for
+    SortedView sorted_views[SORT_VIEWS_KEPT];  // dropped whenever files change
+    int sorted_views_next;  // slot to reuse next
+    PanelRender *render;  // what is on screen, NULL when the whole panel has to be drawn
+    unsigned char *selected;  // bitmap of entries selected with Insert key, by their index in files
+    int *rows;  // row showing each entry of files, -1 if none, checked against order on use and rebuilt when stale
+    int rows_capacity;
+    int view_capacity;  // entries order and selected have room for
+    DirKey dir_key;  // directory state when files were read
+    int watch_wd;  // inotify watch on path, 0 if none
+    int watch_rescan;  // too many or unknown changes, read whole directory again
+    int watch_pending_count;
+    char *watch_pending[WATCH_MAX_PENDING];  // names which changed since the last update
 } PanelProp;
 
 typedef struct file_lines {
@@ -119,6 +312,7 @@ extern PanelProp* active_panel;
 extern WINDOW *win1;
 extern WINDOW *win2;
 extern WINDOW *progress;
+extern SCREEN *screen;
 
 extern struct utsname unameData;
 extern struct passwd *pw;
@@ -136,3 +330,5 @@ extern char cmd[CMD_MAX];
 extern int cmd_len;
 
 extern int color_enabled;
+extern int frame_rate;
+extern int incremental_sorts;
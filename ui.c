@@ -37,8 +37,8 @@ void draw_buttons(int maxY, int maxX) {
 }
 
 void draw_windows(int maxY, int maxX) {
-    // Refresh stdscr to ensure it's updated
-    refresh();
+    // stdscr goes below the panels, nothing is written to the terminal before the frame is complete
+    wnoutrefresh(stdscr);
 
     // Calculate window dimensions
     int winHeight = maxY - 2;
@@ -50,6 +50,15 @@ void draw_windows(int maxY, int maxX) {
         winWidth2 += 1;
     }
 
+    // Panels have to draw everything again, whatever covered them is gone from the screen
+    panel_damage(&left_panel);
+    panel_damage(&right_panel);
+
+    // Windows keep their content, they are only created again when the screen size changed
+    if (win1 != NULL && win2 != NULL && getmaxy(win1) == winHeight && getmaxx(win1) == winWidth1 && getmaxx(win2) == winWidth2) {
+        return;
+    }
+
     // Delete old windows
     delwin(win1);
     delwin(win2);
@@ -65,8 +74,4 @@ void draw_windows(int maxY, int maxX) {
     // Add borders to windows using wborder()
     wborder(win1, '|', '|', '-', '-', '+', '+', '+', '+');
     wborder(win2, '|', '|', '-', '-', '+', '+', '+', '+');
-
-    // Refresh windows to make borders visible
-    wrefresh(win1);
-    wrefresh(win2);
 }
@@ -201,8 +201,6 @@ void display_line(WINDOW *win, file_lines *line, int max_x, int current_col, int
             }
         }
     }
-
-    wrefresh(win);
 }
 
 
@@ -320,7 +318,9 @@ int view_edit_file(char *filename, int editor_mode) {
             mvwprintw(toprow_win, 0, max_x - num_width, "        %d/%lld   %lld%%", shown_line_max, num_lines, num_lines > 0 ? 100 * shown_line_max / num_lines : 100);
         }
 
-        wrefresh(toprow_win);
+        // content and top row go out together, getch() below writes the frame with its refresh of stdscr
+        wnoutrefresh(content_win);
+        wnoutrefresh(toprow_win);
 
         if (editor_mode) {
             curs_set(1); // Make cursor visible
@@ -0,0 +1,244 @@
+#include "includes.h"
+#include "types.h"
+#include "globals.h"
+
+// Each panel keeps an inotify watch on its directory. Events only remember which names changed,
+// a burst of events for the same file collapses into one entry, and the names are applied to the
+// existing file list by re-stat'ing them. Big bursts and queue overflows fall back to a full rescan.
+// The main loop reads the queue whenever it is readable, a timer applies the names once they settled.
+
+static int inotify_fd = -1;
+static int settle_timer_fd = -1;  // expires when the pending changes settled
+static struct timeval first_pending = {0}; // when the oldest unapplied event arrived
+
+#define WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+
+static void watch_clear_pending(PanelProp *panel) {
+    for (int i = 0; i < panel->watch_pending_count; i++) {
+        free(panel->watch_pending[i]);
+    }
+    panel->watch_pending_count = 0;
+    panel->watch_rescan = 0;
+}
+
+
+// inotify queue is readable
+static void watch_on_events(int fd, void *arg) {
+    watch_read_events();
+}
+
+
+// Changes settled, or the timer was armed for changes which are gone already
+static void watch_on_settled(int fd, void *arg) {
+    event_consume(fd);
+
+    int wait = watch_settle_timeout();
+    if (wait > 0) {
+        event_timer_set(fd, wait);
+        return;
+    }
+    watch_apply_both_panels();
+    if (wait == 0) event_request_frame();
+}
+
+
+// Start watching panel->path, called right before the directory is scanned
+// so nothing that changes during the scan gets lost
+void panel_watch(PanelProp *panel) {
+    if (inotify_fd == -1) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd == -1) return;
+        event_add(inotify_fd, watch_on_events, NULL);
+        settle_timer_fd = event_timer_new(watch_on_settled, NULL);
+    }
+
+    int old_wd = panel->watch_wd;
+    panel->watch_wd = inotify_add_watch(inotify_fd, panel->path, WATCH_EVENTS);
+    if (panel->watch_wd < 0) panel->watch_wd = 0;
+    if (old_wd > 0 && old_wd != panel->watch_wd) watch_release(old_wd);
+    watch_clear_pending(panel);
+}
+
+
+// Stop watching a directory nobody shows or caches anymore. inotify gives the same
+// descriptor for the same directory, so the other panel or the listing cache may still need it.
+void watch_release(int wd) {
+    if (left_panel.watch_wd == wd || right_panel.watch_wd == wd || dir_cache_uses_watch(wd)) return;
+    inotify_rm_watch(inotify_fd, wd);
+}
+
+
+static void watch_add_pending(PanelProp *panel, const char *name) {
+    if (panel->watch_rescan) return;
+
+    for (int i = 0; i < panel->watch_pending_count; i++) {
+        if (strcmp(panel->watch_pending[i], name) == 0) return;
+    }
+
+    if (panel->watch_pending_count == WATCH_MAX_PENDING) {
+        // too many changes, reading the whole directory again is cheaper
+        watch_clear_pending(panel);
+        panel->watch_rescan = 1;
+        return;
+    }
+
+    panel->watch_pending[panel->watch_pending_count++] = strdup(name);
+}
+
+
+// Read all queued inotify events and remember the names they refer to.
+// Returns 1 if any panel has changes waiting.
+int watch_read_events() {
+    PanelProp *panels[] = {&left_panel, &right_panel};
+    char buffer[16384] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+
+    if (inotify_fd == -1) return 0;
+
+    while ((len = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char *ptr = buffer; ptr < buffer + len; ptr += sizeof(struct inotify_event) + ((struct inotify_event *)ptr)->len) {
+            struct inotify_event *event = (struct inotify_event *)ptr;
+            dir_cache_invalidate_watch(event->mask & IN_Q_OVERFLOW ? 0 : event->wd);
+
+            for (int i = 0; i < 2; i++) {
+                PanelProp *panel = panels[i];
+                if (event->mask & IN_Q_OVERFLOW) {
+                    watch_clear_pending(panel);
+                    panel->watch_rescan = 1;
+                } else if (event->wd == panel->watch_wd) {
+                    if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                        watch_clear_pending(panel);
+                        panel->watch_rescan = 1;
+                    } else if (event->len > 0) {
+                        watch_add_pending(panel, event->name);
+                    }
+                }
+            }
+        }
+    }
+
+    int pending = watch_pending();
+    if (pending && first_pending.tv_sec == 0 && first_pending.tv_usec == 0) {
+        gettimeofday(&first_pending, NULL);
+        event_timer_set(settle_timer_fd, WATCH_SETTLE_MS);
+    }
+    return pending;
+}
+
+
+int watch_pending() {
+    return left_panel.watch_rescan || left_panel.watch_pending_count > 0 ||
+           right_panel.watch_rescan || right_panel.watch_pending_count > 0;
+}
+
+
+// Milliseconds to wait before pending changes get applied, so a burst of events
+// turns into a single redraw. Returns -1 if there is nothing to apply.
+int watch_settle_timeout() {
+    if (!watch_pending()) return -1;
+
+    struct timeval now, diff;
+    gettimeofday(&now, NULL);
+    timersub(&now, &first_pending, &diff);
+    long elapsed_ms = diff.tv_sec * 1000 + diff.tv_usec / 1000;
+
+    return elapsed_ms >= WATCH_SETTLE_MS ? 0 : WATCH_SETTLE_MS - elapsed_ms;
+}
+
+
+// Re-stat one changed name and update, add or remove its entry.
+// Panels showing the listing keep their views sorted.
+static void watch_apply_name(FileList *list, int dir_fd, const char *name) {
+    FileNode node = {0};
+    int index = file_list_find(list, name);
+
+    if (index >= 0) {
+        node = list->nodes[index];
+    } else {
+        node.name = file_list_strdup(list, name);
+    }
+
+    // changed files are likely to be looked at, resolve all a row shows
+    if (scan_entry(dir_fd, name, DT_UNKNOWN, SCAN_NEED_DISPLAY, list, &node) != 0) {
+        if (index >= 0) file_list_remove(list, index); // gone
+    } else if (index >= 0) {
+        file_list_update(list, index, &node);
+    } else {
+        file_list_add(list, &node);
+    }
+}
+
+
+// Apply remembered changes to the panel's file list
+void watch_apply(PanelProp *panel) {
+    if (!panel->watch_rescan && panel->watch_pending_count == 0) return;
+
+    PanelProp *other = panel == &left_panel ? &right_panel : &left_panel;
+
+    // names only apply to a sorted view, a listing without one is read again
+    if (panel->watch_rescan || panel->order == NULL) {
+        update_panel_files(panel);
+        return;
+    }
+
+    int dir_fd = open(panel->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd == -1) {
+        update_panel_files(panel);
+        return;
+    }
+
+    dir_key_read(dir_fd, &panel->dir_key);
+    for (int i = 0; i < panel->watch_pending_count; i++) {
+        watch_apply_name(panel->files, dir_fd, panel->watch_pending[i]);
+    }
+    close(dir_fd);
+    watch_clear_pending(panel);
+
+    // a shared listing got the changes of the other panel too, they came from the same watch
+    if (other->files == panel->files && !other->watch_rescan) {
+        other->dir_key = panel->dir_key;
+        watch_clear_pending(other);
+    }
+}
+
+
+// The cursor stays on the same file when it still exists, and stays visible if the file moved
+static void watch_keep_cursor(PanelProp *panel, const char *cursor_name) {
+    int index = panel_find_file(panel, cursor_name);
+    if (index >= 0) panel->selected_index = index;
+    if (panel->selected_index > panel->files_count - 1) panel->selected_index = panel->files_count - 1;
+    if (panel->selected_index < 0) panel->selected_index = 0;
+
+    WINDOW *win = panel_window(panel);
+    int visible_items = win ? getmaxy(win) - 5 : 0;
+    if (panel->selected_index < panel->scroll_index || panel->selected_index >= panel->scroll_index + visible_items) {
+        panel->scroll_index = panel->selected_index - visible_items / 2;
+        if (panel->scroll_index < 0) panel->scroll_index = 0;
+    }
+}
+
+
+void watch_apply_both_panels() {
+    PanelProp *panels[] = {&left_panel, &right_panel};
+    char cursor_names[2][CMD_MAX];
+    int changed[2];
+
+    // a shared listing changes under both panels, so both cursors are remembered first
+    for (int i = 0; i < 2; i++) {
+        FileNode *node = panel_file(panels[i], panels[i]->selected_index);
+        snprintf(cursor_names[i], CMD_MAX, "%s", node ? node->name : "");
+        changed[i] = panels[i]->watch_rescan || panels[i]->watch_pending_count > 0;
+    }
+
+    for (int i = 0; i < 2; i++) {
+        watch_apply(panels[i]);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (changed[i]) watch_keep_cursor(panels[i], cursor_names[i]);
+    }
+
+    first_pending.tv_sec = 0;
+    first_pending.tv_usec = 0;
+}